@@ -0,0 +1,68 @@
+#ifndef CLIENT_H
+#define CLIENT_H
+
+#include <cerrno>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "protocol.h"
+
+// Blocking client side of the protocol in protocol.h, for logmine_client and
+// the tests
+
+auto connect_to(const std::string& path) -> int {
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+        auto error = std::string{"failed to connect to "} + path + ": " + std::strerror(errno);
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        throw std::runtime_error{error};
+    }
+    return fd;
+}
+
+void write_all(int fd, const std::string& data) {
+    std::size_t written = 0;
+    while (written < data.size()) {
+        auto n = ::write(fd, data.data() + written, data.size() - written);
+        if (n <= 0) {
+            throw std::runtime_error{"write failed"};
+        }
+        written += n;
+    }
+}
+
+// Blocks until a whole frame is buffered, returns its type and body and
+// drops it from the buffer. Returns nothing once the server has closed the
+// connection.
+auto read_frame(int fd, std::string& buffer) -> std::optional<std::pair<MessageType, std::string>> {
+    while (true) {
+        Frame frame{};
+        auto used = decode_frame(buffer, frame);
+        if (used > 0) {
+            auto result = std::make_pair(frame.type, std::string{frame.body});
+            buffer.erase(0, used);
+            return result;
+        }
+
+        char buf[65536];
+        auto n = ::read(fd, buf, sizeof(buf));
+        if (n <= 0) {
+            return std::nullopt;
+        }
+        buffer.append(buf, n);
+    }
+}
+
+#endif // CLIENT_H
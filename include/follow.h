@@ -0,0 +1,192 @@
+#ifndef FOLLOW_H
+#define FOLLOW_H
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <system_error>
+
+#include <fcntl.h>
+#include <libgen.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+// Follows a set of growing log files the way `tail -F` does. Each file is
+// tracked by (device, inode) and a byte offset so only appended data is ever
+// read. Rotation by rename/re-create is detected by the inode under the path
+// changing, and copy-truncate rotation by the file shrinking below the offset.
+//
+// inotify watches are placed on the parent directories rather than the files
+// themselves so a re-created file is picked up without re-arming watches. The
+// events are only used as a wake-up; every poll re-checks the files, so
+// filesystems without inotify support still work at the poll interval.
+class Follower {
+
+    struct File {
+        std::string path;
+        int fd = -1;
+        dev_t dev = 0;
+        ino_t ino = 0;
+        off_t offset = 0;
+        std::string partial;
+    };
+
+    std::vector<File> files;
+    int inotify_fd;
+
+public:
+    explicit Follower(const std::vector<std::string>& paths, bool from_start = false) {
+        inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotify_fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "inotify_init1");
+        }
+
+        for (const auto& path : paths) {
+            File f;
+            f.path = path;
+            open_file(f, from_start);
+            files.push_back(std::move(f));
+
+            std::string dir{path};
+            const auto mask = IN_MODIFY | IN_CREATE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_CLOSE_WRITE;
+            if (inotify_add_watch(inotify_fd, dirname(dir.data()), mask) < 0) {
+                throw std::system_error(errno, std::generic_category(), "inotify_add_watch " + path);
+            }
+        }
+    }
+
+    Follower(const Follower&) = delete;
+    auto operator=(const Follower&) -> Follower& = delete;
+
+    ~Follower() {
+        for (auto& f : files) {
+            if (f.fd >= 0) {
+                ::close(f.fd);
+            }
+        }
+        ::close(inotify_fd);
+    }
+
+    // Waits up to timeout_ms for a change to any followed file and hands every
+    // complete new line to on_line. Returns the number of lines delivered.
+    auto poll(int timeout_ms, const std::function<void(const std::string&)>& on_line) -> std::size_t {
+        wait(timeout_ms);
+        return read(on_line);
+    }
+
+    // Blocks until inotify reports activity or the timeout expires
+    auto wait(int timeout_ms) -> bool {
+        pollfd pfd{inotify_fd, POLLIN, 0};
+        if (::poll(&pfd, 1, timeout_ms) <= 0) {
+            return false;
+        }
+        drain_events();
+        return true;
+    }
+
+    // Reads everything appended to the followed files since the last read
+    auto read(const std::function<void(const std::string&)>& on_line) -> std::size_t {
+        std::size_t lines = 0;
+        for (auto& f : files) {
+            lines += check(f, on_line);
+        }
+        return lines;
+    }
+
+    [[nodiscard]] auto offset(std::size_t i) const -> off_t {
+        return files[i].offset;
+    }
+
+private:
+
+    void drain_events() {
+        alignas(inotify_event) char buf[4096];
+        while (::read(inotify_fd, buf, sizeof(buf)) > 0) {
+        }
+    }
+
+    void open_file(File& f, bool from_start) {
+        f.fd = ::open(f.path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (f.fd < 0) {
+            return;
+        }
+
+        struct stat st{};
+        ::fstat(f.fd, &st);
+        f.dev = st.st_dev;
+        f.ino = st.st_ino;
+        f.offset = from_start ? 0 : st.st_size;
+        f.partial.clear();
+    }
+
+    auto check(File& f, const std::function<void(const std::string&)>& on_line) -> std::size_t {
+        if (f.fd < 0) {
+            // Files that appear after we started are read from the beginning
+            open_file(f, true);
+            if (f.fd < 0) {
+                return 0;
+            }
+        }
+
+        // Whatever was appended to the file we hold open is read first, so
+        // lines written just before a rotation are not lost
+        auto lines = read_appended(f, on_line);
+
+        struct stat st{};
+        if (::stat(f.path.c_str(), &st) == 0 && (st.st_dev != f.dev || st.st_ino != f.ino)) {
+            // Rotated, the old file can't grow any more so flush its last line
+            if (!f.partial.empty()) {
+                on_line(f.partial);
+                ++lines;
+            }
+            ::close(f.fd);
+            open_file(f, true);
+            if (f.fd >= 0) {
+                lines += read_appended(f, on_line);
+            }
+            return lines;
+        }
+
+        if (::fstat(f.fd, &st) == 0 && st.st_size < f.offset) {
+            // Truncated in place (copytruncate)
+            f.offset = 0;
+            f.partial.clear();
+            lines += read_appended(f, on_line);
+        }
+
+        return lines;
+    }
+
+    auto read_appended(File& f, const std::function<void(const std::string&)>& on_line) -> std::size_t {
+        std::size_t lines = 0;
+        char buf[65536];
+
+        ssize_t n;
+        while ((n = ::pread(f.fd, buf, sizeof(buf), f.offset)) > 0) {
+            f.offset += n;
+
+            const char* start = buf;
+            const char* end = buf + n;
+            for (const char* p = start; p != end; ++p) {
+                if (*p != '\n') {
+                    continue;
+                }
+                f.partial.append(start, p);
+                if (!f.partial.empty() && f.partial.back() == '\r') {
+                    f.partial.pop_back();
+                }
+                on_line(f.partial);
+                f.partial.clear();
+                ++lines;
+                start = p + 1;
+            }
+            f.partial.append(start, end);
+        }
+
+        return lines;
+    }
+};
+
+#endif // FOLLOW_H
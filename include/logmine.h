@@ -2,12 +2,18 @@
 #define LOGMINE_H
 
 #include <vector>
+#include <array>
 #include <regex>
 #include <iterator>
 #include <iostream>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <unordered_map>
 
 #include "tokens.h"
 #include "align.h"
+#include "rates.h"
 
 template<typename T, int K = 1>
 inline auto score(const T& t1, const T& t2) -> float {
@@ -24,8 +30,8 @@ auto distance(const std::vector<Token>& log1, const std::vector<Token>& log2) ->
     auto sum = 0.0;
 
     for (auto i = 0; i < min; ++i) {
-        auto t1 = log1[i];
-        auto t2 = log2[i];
+        const auto& t1 = log1[i];
+        const auto& t2 = log2[i];
 
         auto s = score(t1, t2);
         sum += s / max;
@@ -37,53 +43,477 @@ auto distance(const std::vector<Token>& log1, const std::vector<Token>& log2) ->
 class Cluster {
 
     std::vector<Token> rep;
-    int size_;
+    std::int64_t size_;
+
+    // Activity since the last Logmine::snapshot()
+    std::int64_t interval_hits_;
+    bool is_new_;
+    bool rep_changed_;
+
+    ClusterRates rates_;
+
+    Cluster(std::vector<Token> rep, std::int64_t size, ClusterRates rates) : rep{std::move(rep)}, size_{size}, interval_hits_{0}, is_new_{false}, rep_changed_{false}, rates_{rates} {}
 
 public:
-    Cluster(std::vector<Token> rep) : rep{std::move(rep)}, size_{1} {}
+    Cluster(std::vector<Token> rep) : rep{std::move(rep)}, size_{1}, interval_hits_{1}, is_new_{true}, rep_changed_{false} {}
     Cluster(const Cluster& cluster) = default;
 
-    auto cluster_distance(const std::vector<Token>& log) -> float {
+    auto cluster_distance(const std::vector<Token>& log) const -> float {
         return std::abs(distance(rep, log));
     }
 
     void add(const std::vector<Token>& log) {
         ++size_;
+        ++interval_hits_;
         auto [leftOut, rightOut] = align2<Token>(rep, log, Gap("-"), score<Token>);
 
         std::vector<Token> merged = merge(leftOut, rightOut);
 
-        rep = merged;
+        if (!(merged == rep)) {
+            rep = merged;
+            rep_changed_ = true;
+        }
     }
 
-    [[nodiscard]] auto size() const -> int {
+    // Counts a log without touching the representative
+    void hit() {
+        ++size_;
+        ++interval_hits_;
+    }
+
+    // Folds a cluster from another model into this one. The representatives
+    // are merged the same way a log is, and sizes and rates are summed.
+    void absorb(const Cluster& other) {
+        size_ += other.size_;
+        rates_.merge(other.rates_);
+        auto [leftOut, rightOut] = align2<Token>(rep, other.rep, Gap("-"), score<Token>);
+
+        std::vector<Token> merged = merge(leftOut, rightOut);
+
+        if (!(merged == rep)) {
+            rep = merged;
+            rep_changed_ = true;
+        }
+    }
+
+    [[nodiscard]] auto size() const -> std::int64_t {
         return this->size_;
     }
 
+    [[nodiscard]] auto representative() const -> const std::vector<Token>& {
+        return this->rep;
+    }
+
     [[nodiscard]] auto id() const -> std::string {
         return untokenize(rep, " ");
     }
+
+    void record(std::int64_t timestamp) {
+        rates_.add(timestamp);
+    }
+
+    [[nodiscard]] auto rates() const -> const ClusterRates& {
+        return this->rates_;
+    }
+
+    [[nodiscard]] auto interval_hits() const -> std::int64_t {
+        return this->interval_hits_;
+    }
+
+    [[nodiscard]] auto is_new() const -> bool {
+        return this->is_new_;
+    }
+
+    [[nodiscard]] auto rep_changed() const -> bool {
+        return this->rep_changed_;
+    }
+
+    void reset_interval() {
+        interval_hits_ = 0;
+        is_new_ = false;
+        rep_changed_ = false;
+    }
+
+    // One line per cluster: size, token count, Type:text tokens, then rates
+    void save(std::ostream& out) const {
+        out << size_ << ' ' << rep.size();
+        for (const auto& token : rep) {
+            out << ' ' << token_to_str(token.token_type()) << ':' << token.to_str();
+        }
+        out << ' ';
+        rates_.save(out);
+    }
+
+    static auto load(std::istream& in) -> Cluster {
+        std::int64_t size = 0;
+        std::size_t length = 0;
+        in >> size >> length;
+
+        std::vector<Token> rep;
+        rep.reserve(length);
+        for (std::size_t i = 0; i < length && in; ++i) {
+            std::string str;
+            in >> str;
+            auto colon = str.find(':');
+            if (colon == std::string::npos) {
+                throw std::runtime_error{"malformed token: " + str};
+            }
+            rep.emplace_back(str.substr(colon + 1), str_to_token(str.substr(0, colon)));
+        }
+
+        ClusterRates rates;
+        rates.load(in);
+
+        if (!in) {
+            throw std::runtime_error{"truncated cluster"};
+        }
+        return Cluster{std::move(rep), size, rates};
+    }
 };
 
+// Inverted index from (position, token) to the clusters whose representative
+// holds that token at that position. distance() only credits equal tokens at
+// equal positions, so a cluster can only be within max_dist of a log if it
+// shares enough of these pairs with it.
+//
+// Posting lists are visited shortest first. Once the positions left to visit
+// could no longer bring an unseen cluster under max_dist no more candidates
+// are admitted, so tokens shared by nearly every cluster (dates, log levels)
+// are never scanned. The candidates are a superset of the matches and are
+// meant to be checked with distance().
+class ClusterIndex {
+
+    static constexpr std::uint32_t unknown = std::numeric_limits<std::uint32_t>::max();
+
+    // Token ids, one map per token type
+    std::array<std::unordered_map<std::string, std::uint32_t>, static_cast<std::size_t>(Tokens::DateTime) + 1> ids;
+    std::uint32_t next_id = 0;
+    std::unordered_map<std::uint64_t, std::vector<std::uint32_t>> postings;
+
+    // Token ids of each cluster's current representative, used to skip
+    // postings left behind when a representative changes
+    std::vector<std::vector<std::uint32_t>> reps;
+
+    static auto posting(std::size_t position, std::uint32_t id) -> std::uint64_t {
+        return (static_cast<std::uint64_t>(position) << 32) | id;
+    }
+
+    // Fewest equal positions that bring a log of this length under max_dist,
+    // worked out with the same float arithmetic as distance() so a match is
+    // never one position short of the bound. Longer representatives only
+    // need more.
+    static auto min_shared(std::size_t length, float max_dist) -> std::size_t {
+        auto sum = 0.0;
+        for (std::size_t shared = 0; shared <= length; ++shared) {
+            if (std::abs(static_cast<float>(1 - sum)) < max_dist) {
+                return shared;
+            }
+            sum += 1.0f / length;
+        }
+        return length + 1;
+    }
+
+    [[nodiscard]] auto id_of(const Token& token) const -> std::uint32_t {
+        const auto& type_ids = ids[static_cast<std::size_t>(token.token_type())];
+        auto it = type_ids.find(token.to_str());
+        return it == type_ids.end() ? unknown : it->second;
+    }
+
+public:
+    // Adds a cluster or refreshes it after its representative changed
+    void update(std::size_t cluster, const std::vector<Token>& rep) {
+        if (cluster >= reps.size()) {
+            reps.resize(cluster + 1);
+        }
+
+        auto& old = reps[cluster];
+        std::vector<std::uint32_t> current(rep.size());
+        for (std::size_t i = 0; i < rep.size(); ++i) {
+            auto [it, inserted] = ids[static_cast<std::size_t>(rep[i].token_type())].try_emplace(rep[i].to_str(), next_id);
+            if (inserted) {
+                ++next_id;
+            }
+            current[i] = it->second;
+            if (i >= old.size() || old[i] != current[i]) {
+                postings[posting(i, current[i])].push_back(cluster);
+            }
+        }
+        old = std::move(current);
+    }
+
+    [[nodiscard]] auto candidates(const std::vector<Token>& log, float max_dist) const -> std::vector<std::size_t> {
+        struct List {
+            std::size_t position;
+            std::uint32_t id;
+            const std::vector<std::uint32_t>* clusters;
+        };
+
+        std::vector<List> lists;
+        lists.reserve(log.size());
+        for (std::size_t i = 0; i < log.size(); ++i) {
+            auto id = id_of(log[i]);
+            if (id == unknown) {
+                continue;
+            }
+            auto it = postings.find(posting(i, id));
+            if (it != postings.end()) {
+                lists.push_back(List{i, id, &it->second});
+            }
+        }
+        std::sort(lists.begin(), lists.end(), [](const List& a, const List& b) { return a.clusters->size() < b.clusters->size(); });
+
+        // A match needs at least this many equal positions
+        const auto needed = min_shared(log.size(), max_dist);
+
+        std::unordered_map<std::uint32_t, std::size_t> counts;
+        counts.reserve(64);
+        auto remaining = lists.size();
+        for (const auto& list : lists) {
+            if (remaining < needed) {
+                break;
+            }
+            for (auto cluster : *list.clusters) {
+                const auto& rep = reps[cluster];
+                if (list.position < rep.size() && rep[list.position] == list.id) {
+                    ++counts[cluster];
+                }
+            }
+            --remaining;
+        }
+
+        std::vector<std::size_t> found;
+        for (auto [cluster, count] : counts) {
+            if (count + remaining >= needed) {
+                found.push_back(cluster);
+            }
+        }
+        std::sort(found.begin(), found.end());
+        return found;
+    }
+};
+
+// What happened to one cluster between two calls to Logmine::snapshot()
+struct ClusterDelta {
+    std::size_t index;
+    std::string id;
+    std::int64_t hits;
+    std::int64_t size;
+    bool is_new;
+    bool rep_changed;
+};
+
+// A log split into tokens along with its timestamp, see Logmine::prepare().
+// The timestamp is negative when it is left for the model to fill in.
+struct TokenizedLog {
+    std::vector<Token> tokens;
+    std::int64_t timestamp;
+};
+
+// Where the time used for the per cluster rates comes from. Parsed uses the
+// log's own DateTime or Date and Time tokens. Logs without them, such as stack
+// trace continuations, get the latest timestamp seen so far, and only fall
+// back to the wall clock before the first parsed timestamp.
+enum class TimeSource {Parsed, WallClock};
+
 class Logmine {
 
+    static constexpr float max_dist = 0.5;
+
     std::vector<Cluster> clusters;
 
+    TimeSource time_source;
+    // Latest timestamp that came with a log, never one filled in by the
+    // wall clock fallback
+    std::int64_t latest_ = std::numeric_limits<std::int64_t>::min();
+
+    // Indexes of clusters touched since the last snapshot, so a snapshot
+    // only visits the clusters that actually saw traffic
+    std::vector<std::size_t> touched;
+
 public:
-    void add(const std::string& log) {
-        std::vector<Token> tokenized_log = tokenize(log);
-        find_cluster(tokenized_log);
+    explicit Logmine(TimeSource time_source = TimeSource::Parsed) : time_source{time_source} {}
+
+    // Returns the index of the cluster the log was assigned to
+    auto add(const std::string& log) -> std::size_t {
+        return add(prepare(log));
+    }
+
+    auto add(const TokenizedLog& log) -> std::size_t {
+        auto index = find_cluster(log.tokens);
+        record(index, log.timestamp);
+        return index;
+    }
+
+    // Same as add() but finds the cluster through index, which has to cover
+    // every cluster, instead of measuring the distance to each of them. The
+    // index is updated with the new or refined representative.
+    auto add(const TokenizedLog& log, ClusterIndex& index) -> std::size_t {
+        auto found = nearest(index, log.tokens);
+        std::size_t cluster;
+        if (found) {
+            cluster = *found;
+            clusters[cluster].add(log.tokens);
+        } else {
+            cluster = clusters.size();
+            clusters.emplace_back(Cluster(log.tokens));
+        }
+        index.update(cluster, clusters[cluster].representative());
+        record(cluster, log.timestamp);
+        return cluster;
+    }
+
+    // Counts a log against a cluster it is already known to belong to,
+    // skipping the alignment that would refine the representative
+    void add_to(std::size_t index, std::int64_t timestamp) {
+        clusters[index].hit();
+        record(index, timestamp);
+    }
+
+    // Tokenizes a log and, with the wall clock as time source, stamps it.
+    // This doesn't touch the model so it can run on other threads ahead of
+    // add(), which is why a missing parsed timestamp is only resolved there.
+    [[nodiscard]] auto prepare(const std::string& log) const -> TokenizedLog {
+        std::int64_t timestamp = -1;
+        auto tokens = tokenize(log, time_source == TimeSource::Parsed ? &timestamp : nullptr);
+        if (time_source == TimeSource::WallClock) {
+            timestamp = wall_clock();
+        }
+        return TokenizedLog{std::move(tokens), timestamp};
     }
 
     auto get_clusters() -> const std::vector<Cluster> {
         return clusters;
     }
 
+    // Folds another model, possibly built on another host, into this one.
+    // Each cluster of other is matched against this model's clusters with
+    // the same distance() threshold add() uses, through a ClusterIndex so the
+    // cost isn't the product of the cluster counts. Matches are merged with
+    // align2/merge and their sizes and rates summed; the rest are appended.
+    //
+    // Every line of both models is counted exactly once whatever the order,
+    // so results can be combined in a tree. As with add(), representatives
+    // can come out differently when near-identical clusters meet in another
+    // order.
+    void merge(const Logmine& other) {
+        ClusterIndex index = build_index();
+        for (const auto& cluster : other.clusters) {
+            auto found = nearest(index, cluster.representative());
+            if (found) {
+                clusters[*found].absorb(cluster);
+                index.update(*found, clusters[*found].representative());
+            } else {
+                clusters.push_back(cluster);
+                clusters.back().reset_interval();
+                index.update(clusters.size() - 1, cluster.representative());
+            }
+        }
+        latest_ = std::max(latest_, other.latest_);
+    }
+
+    void save(std::ostream& out) const {
+        out << "logmine 1 " << clusters.size() << '\n';
+        for (const auto& cluster : clusters) {
+            cluster.save(out);
+            out << '\n';
+        }
+    }
+
+    static auto load(std::istream& in) -> Logmine {
+        std::string magic;
+        int version = 0;
+        std::size_t count = 0;
+        in >> magic >> version >> count;
+        if (!in || magic != "logmine" || version != 1) {
+            throw std::runtime_error{"not a logmine model"};
+        }
+
+        Logmine model;
+        model.clusters.reserve(count);
+        for (std::size_t i = 0; i < count; ++i) {
+            model.clusters.push_back(Cluster::load(in));
+            model.latest_ = std::max(model.latest_, model.clusters.back().rates().last_seen());
+        }
+        return model;
+    }
+
+    [[nodiscard]] auto build_index() const -> ClusterIndex {
+        ClusterIndex index;
+        for (std::size_t i = 0; i < clusters.size(); ++i) {
+            index.update(i, clusters[i].representative());
+        }
+        return index;
+    }
+
+    // Same choice find_cluster() makes, the closest cluster under max_dist
+    // with ties going to the oldest, restricted to the index's candidates.
+    // Safe to call from several threads while the model isn't modified.
+    [[nodiscard]] auto nearest(const ClusterIndex& index, const std::vector<Token>& log) const -> std::optional<std::size_t> {
+        auto d = std::numeric_limits<float>::max();
+        std::optional<std::size_t> found;
+        for (auto candidate : index.candidates(log, max_dist)) {
+            auto d1 = clusters[candidate].cluster_distance(log);
+            if (d1 < max_dist && d1 < d) {
+                d = d1;
+                found = candidate;
+            }
+        }
+        return found;
+    }
+
+    [[nodiscard]] auto get_cluster(std::size_t index) const -> const Cluster& {
+        return clusters[index];
+    }
+
+    [[nodiscard]] auto cluster_count() const -> std::size_t {
+        return clusters.size();
+    }
+
+    [[nodiscard]] auto rates(std::size_t index) const -> const ClusterRates& {
+        return clusters[index].rates();
+    }
+
+    // The most recent timestamp seen, the natural "now" for rate queries
+    // when replaying logs with parsed timestamps. The wall clock until the
+    // first one arrives.
+    [[nodiscard]] auto latest() const -> std::int64_t {
+        return latest_ != std::numeric_limits<std::int64_t>::min() ? latest_ : wall_clock();
+    }
+
+    static auto wall_clock() -> std::int64_t {
+        using namespace std::chrono;
+        return duration_cast<seconds>(system_clock::now().time_since_epoch()).count();
+    }
+
+    // Reports the clusters that were created, changed representative or
+    // received lines since the previous snapshot and starts a new interval
+    auto snapshot() -> std::vector<ClusterDelta> {
+        std::vector<ClusterDelta> deltas;
+        deltas.reserve(touched.size());
+        for (auto index : touched) {
+            auto& cluster = clusters[index];
+            deltas.push_back(ClusterDelta{index, cluster.id(), cluster.interval_hits(), cluster.size(), cluster.is_new(), cluster.rep_changed()});
+            cluster.reset_interval();
+        }
+        touched.clear();
+        return deltas;
+    }
+
 private:
 
-    auto find_cluster(const std::vector<Token>& log) -> void {
-        // TODO: Where to put this?
-        const auto max_dist = 0.5;
+    void record(std::size_t index, std::int64_t timestamp) {
+        if (timestamp < 0) {
+            timestamp = latest();
+        } else {
+            latest_ = std::max(latest_, timestamp);
+        }
+        clusters[index].record(timestamp);
+        if (clusters[index].interval_hits() == 1) {
+            touched.push_back(index);
+        }
+    }
+
+    auto find_cluster(const std::vector<Token>& log) -> std::size_t {
         // Find the distance from the log to the cluster
         auto d = std::numeric_limits<float>::max();
         Cluster* found_cluster = nullptr;
@@ -97,9 +527,11 @@ private:
 
         if (found_cluster != nullptr) {
             found_cluster->add(log);
-        } else {
-            clusters.emplace_back(Cluster(log));
+            return found_cluster - clusters.data();
         }
+
+        clusters.emplace_back(Cluster(log));
+        return clusters.size() - 1;
     }
 };
 
@@ -0,0 +1,141 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <algorithm>
+#include <iterator>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+// Wire format between `logmine --serve` and its clients. Client and server
+// share a host so integers are in native byte order.
+//
+//   frame  := length:u32 type:u32 body      (length counts type and body)
+//   Lines  := count:u32 (size:u32 bytes)*   request, a batch of log lines
+//   Ids    := count:u32 (cluster:u32)*      response, one cluster per line,
+//                                           no_cluster for lines without tokens
+//   Stats  := text                          empty request, text response
+//
+// A connection gets exactly one response per request, in request order.
+
+enum class MessageType : std::uint32_t {Lines = 1, Ids = 2, Stats = 3};
+
+// Cluster id given to blank lines, which are not clustered
+constexpr std::uint32_t no_cluster = 0xffffffff;
+
+// Larger frames are refused and the connection closed
+constexpr std::size_t max_frame_size = 64 * 1024 * 1024;
+
+struct Frame {
+    MessageType type;
+    std::string_view body;
+};
+
+void put_u32(std::string& out, std::uint32_t value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+auto get_u32(std::string_view& in) -> std::uint32_t {
+    if (in.size() < sizeof(std::uint32_t)) {
+        throw std::runtime_error{"truncated message"};
+    }
+    std::uint32_t value;
+    std::memcpy(&value, in.data(), sizeof(value));
+    in.remove_prefix(sizeof(value));
+    return value;
+}
+
+// Starts a frame, finish_frame() fills in the length once the body is written
+auto start_frame(MessageType type) -> std::string {
+    std::string out;
+    put_u32(out, 0);
+    put_u32(out, static_cast<std::uint32_t>(type));
+    return out;
+}
+
+void finish_frame(std::string& frame) {
+    auto length = static_cast<std::uint32_t>(frame.size() - sizeof(std::uint32_t));
+    std::memcpy(frame.data(), &length, sizeof(length));
+}
+
+template<typename Lines>
+auto encode_lines(const Lines& lines) -> std::string {
+    auto frame = start_frame(MessageType::Lines);
+    put_u32(frame, static_cast<std::uint32_t>(std::size(lines)));
+    for (const auto& line : lines) {
+        put_u32(frame, static_cast<std::uint32_t>(line.size()));
+        frame.append(line.data(), line.size());
+    }
+    finish_frame(frame);
+    return frame;
+}
+
+auto encode_ids(const std::vector<std::uint32_t>& ids) -> std::string {
+    auto frame = start_frame(MessageType::Ids);
+    put_u32(frame, static_cast<std::uint32_t>(ids.size()));
+    frame.append(reinterpret_cast<const char*>(ids.data()), ids.size() * sizeof(std::uint32_t));
+    finish_frame(frame);
+    return frame;
+}
+
+auto encode_stats(const std::string& text = "") -> std::string {
+    auto frame = start_frame(MessageType::Stats);
+    frame.append(text);
+    finish_frame(frame);
+    return frame;
+}
+
+// Returns the number of bytes the frame at the start of data takes, or 0 when
+// data doesn't hold a whole frame yet. Throws on frames that can't be valid.
+auto decode_frame(std::string_view data, Frame& frame) -> std::size_t {
+    if (data.size() < sizeof(std::uint32_t)) {
+        return 0;
+    }
+    auto in = data;
+    auto length = get_u32(in);
+    if (length < sizeof(std::uint32_t) || length > max_frame_size) {
+        throw std::runtime_error{"bad frame length"};
+    }
+    if (in.size() < length) {
+        return 0;
+    }
+
+    auto type = get_u32(in);
+    if (type < static_cast<std::uint32_t>(MessageType::Lines) || type > static_cast<std::uint32_t>(MessageType::Stats)) {
+        throw std::runtime_error{"unknown message type"};
+    }
+
+    frame.type = static_cast<MessageType>(type);
+    frame.body = in.substr(0, length - sizeof(std::uint32_t));
+    return sizeof(std::uint32_t) + length;
+}
+
+auto decode_lines(std::string_view body) -> std::vector<std::string> {
+    auto count = get_u32(body);
+    std::vector<std::string> lines;
+    lines.reserve(std::min<std::size_t>(count, body.size() / sizeof(std::uint32_t)));
+    for (std::uint32_t i = 0; i < count; ++i) {
+        auto size = get_u32(body);
+        if (body.size() < size) {
+            throw std::runtime_error{"truncated line"};
+        }
+        lines.emplace_back(body.substr(0, size));
+        body.remove_prefix(size);
+    }
+    return lines;
+}
+
+auto decode_ids(std::string_view body) -> std::vector<std::uint32_t> {
+    auto count = get_u32(body);
+    if (body.size() != count * sizeof(std::uint32_t)) {
+        throw std::runtime_error{"bad id count"};
+    }
+    std::vector<std::uint32_t> ids(count);
+    std::memcpy(ids.data(), body.data(), body.size());
+    return ids;
+}
+
+#endif // PROTOCOL_H
@@ -0,0 +1,185 @@
+#ifndef RATES_H
+#define RATES_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <limits>
+
+// A ring of BUCKETS counters, each covering SECONDS seconds. Every slot
+// remembers which bucket it currently holds so stale slots are recycled
+// lazily on the next add instead of being cleared by a timer.
+template<int BUCKETS, int SECONDS>
+class RateWindow {
+
+    std::array<std::uint64_t, BUCKETS> counts{};
+    std::array<std::int64_t, BUCKETS> buckets{};
+
+    static auto bucket_of(std::int64_t t) -> std::int64_t {
+        return t >= 0 ? t / SECONDS : (t - SECONDS + 1) / SECONDS;
+    }
+
+    static auto slot_of(std::int64_t bucket) -> int {
+        return static_cast<int>(((bucket % BUCKETS) + BUCKETS) % BUCKETS);
+    }
+
+public:
+    RateWindow() {
+        buckets.fill(std::numeric_limits<std::int64_t>::min());
+    }
+
+    void add(std::int64_t t, std::uint64_t n = 1) {
+        auto bucket = bucket_of(t);
+        auto slot = slot_of(bucket);
+        if (buckets[slot] != bucket) {
+            if (buckets[slot] > bucket) {
+                // Older than anything the window still holds
+                return;
+            }
+            buckets[slot] = bucket;
+            counts[slot] = 0;
+        }
+        counts[slot] += n;
+    }
+
+    // Count in the bucket `ago` buckets before the one containing t
+    [[nodiscard]] auto count(std::int64_t t, int ago = 0) const -> std::uint64_t {
+        if (ago < 0 || ago >= BUCKETS) {
+            return 0;
+        }
+        auto bucket = bucket_of(t) - ago;
+        auto slot = slot_of(bucket);
+        return buckets[slot] == bucket ? counts[slot] : 0;
+    }
+
+    // Sum of the n buckets ending with the one containing t
+    [[nodiscard]] auto sum(std::int64_t t, int n = BUCKETS) const -> std::uint64_t {
+        std::uint64_t total = 0;
+        for (auto ago = 0; ago < n && ago < BUCKETS; ++ago) {
+            total += count(t, ago);
+        }
+        return total;
+    }
+
+    void merge(const RateWindow& other) {
+        for (auto slot = 0; slot < BUCKETS; ++slot) {
+            if (other.buckets[slot] != std::numeric_limits<std::int64_t>::min()) {
+                add(other.buckets[slot] * SECONDS, other.counts[slot]);
+            }
+        }
+    }
+
+    // Written as the number of live buckets followed by bucket/count pairs
+    void save(std::ostream& out) const {
+        auto live = std::count_if(buckets.begin(), buckets.end(), [](auto bucket) { return bucket != std::numeric_limits<std::int64_t>::min(); });
+        out << live;
+        for (auto slot = 0; slot < BUCKETS; ++slot) {
+            if (buckets[slot] != std::numeric_limits<std::int64_t>::min()) {
+                out << ' ' << buckets[slot] << ' ' << counts[slot];
+            }
+        }
+    }
+
+    void load(std::istream& in) {
+        std::size_t live = 0;
+        in >> live;
+        for (std::size_t i = 0; i < live && in; ++i) {
+            std::int64_t bucket = 0;
+            std::uint64_t count = 0;
+            in >> bucket >> count;
+            add(bucket * SECONDS, count);
+        }
+    }
+};
+
+// Per cluster activity over the last minute by second, the last hour by
+// minute and the last day by hour. Every add touches one slot per level so
+// the cost is constant and the memory per cluster is fixed, independent of
+// how many lines the cluster has seen.
+class ClusterRates {
+
+    RateWindow<60, 1> seconds_;
+    RateWindow<60, 60> minutes_;
+    RateWindow<24, 3600> hours_;
+
+    std::int64_t first_seen_ = std::numeric_limits<std::int64_t>::max();
+    std::int64_t last_seen_ = std::numeric_limits<std::int64_t>::min();
+
+public:
+    void add(std::int64_t t, std::uint64_t n = 1) {
+        seconds_.add(t, n);
+        minutes_.add(t, n);
+        hours_.add(t, n);
+        first_seen_ = std::min(first_seen_, t);
+        last_seen_ = std::max(last_seen_, t);
+    }
+
+    [[nodiscard]] auto seconds() const -> const RateWindow<60, 1>& {
+        return seconds_;
+    }
+
+    [[nodiscard]] auto minutes() const -> const RateWindow<60, 60>& {
+        return minutes_;
+    }
+
+    [[nodiscard]] auto hours() const -> const RateWindow<24, 3600>& {
+        return hours_;
+    }
+
+    [[nodiscard]] auto first_seen() const -> std::int64_t {
+        return first_seen_;
+    }
+
+    [[nodiscard]] auto last_seen() const -> std::int64_t {
+        return last_seen_;
+    }
+
+    // True when the current minute saw more than `factor` times the average
+    // of the previous minutes of the hour and at least min_count lines
+    [[nodiscard]] auto is_spike(std::int64_t now, double factor = 3.0, std::uint64_t min_count = 10) const -> bool {
+        auto current = minutes_.count(now);
+        if (current < min_count) {
+            return false;
+        }
+        auto baseline = static_cast<double>(minutes_.sum(now) - current) / 59;
+        return current > factor * baseline;
+    }
+
+    // True when the pattern was first seen within the last `window` seconds
+    [[nodiscard]] auto is_new(std::int64_t now, std::int64_t window = 60) const -> bool {
+        return first_seen_ <= now && first_seen_ > now - window;
+    }
+
+    // True when the pattern has not been seen for at least `window` seconds
+    [[nodiscard]] auto has_vanished(std::int64_t now, std::int64_t window = 3600) const -> bool {
+        return last_seen_ <= now - window;
+    }
+
+    void merge(const ClusterRates& other) {
+        seconds_.merge(other.seconds_);
+        minutes_.merge(other.minutes_);
+        hours_.merge(other.hours_);
+        first_seen_ = std::min(first_seen_, other.first_seen_);
+        last_seen_ = std::max(last_seen_, other.last_seen_);
+    }
+
+    void save(std::ostream& out) const {
+        out << first_seen_ << ' ' << last_seen_ << ' ';
+        seconds_.save(out);
+        out << ' ';
+        minutes_.save(out);
+        out << ' ';
+        hours_.save(out);
+    }
+
+    void load(std::istream& in) {
+        in >> first_seen_ >> last_seen_;
+        seconds_.load(in);
+        minutes_.load(in);
+        hours_.load(in);
+    }
+};
+
+#endif // RATES_H
@@ -0,0 +1,208 @@
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <random>
+#include <optional>
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_map>
+
+#include "logmine.h"
+
+// Two phase clustering for large inputs. A sample of the lines is clustered
+// the usual way, with every line aligned into its cluster's representative.
+// The resulting representatives are then frozen, and the remaining lines are
+// matched against them with distance() alone, on several threads. Lines that
+// match no frozen cluster are clustered in full on the calling thread, and
+// the clusters that creates are frozen in turn at the end of each batch.
+//
+// Every cluster is kept in a ClusterIndex, so neither phase measures the
+// distance to every cluster.
+class SampleAssign {
+
+    Logmine& model;
+    ClusterIndex index;
+    std::size_t frozen = 0;
+    unsigned threads;
+
+    std::size_t sampled_ = 0;
+    std::size_t assigned_ = 0;
+    std::size_t unmatched_ = 0;
+
+public:
+    explicit SampleAssign(Logmine& model, unsigned threads = std::max(1u, std::thread::hardware_concurrency()))
+        : model{model}, threads{std::max(1u, threads)} {}
+
+    // First phase, full clustering of the sample. Returns the cluster of
+    // each line.
+    auto fit(const std::vector<std::string>& sample) -> std::vector<std::size_t> {
+        freeze();
+
+        std::vector<std::size_t> ids;
+        ids.reserve(sample.size());
+        for (const auto& line : sample) {
+            ids.push_back(model.add(model.prepare(line), index));
+        }
+        frozen = model.cluster_count();
+
+        sampled_ += sample.size();
+        return ids;
+    }
+
+    // Freezes the representatives built so far, including those of clusters
+    // added to the model directly
+    void freeze() {
+        for (; frozen < model.cluster_count(); ++frozen) {
+            index.update(frozen, model.get_cluster(frozen).representative());
+        }
+    }
+
+    // Second phase, assigns a batch of lines to the frozen clusters. Returns
+    // the cluster of each line.
+    auto assign(const std::vector<std::string>& lines) -> std::vector<std::size_t> {
+        freeze();
+
+        struct Assignment {
+            std::optional<std::size_t> cluster;
+            TokenizedLog log;
+        };
+        std::vector<Assignment> assignments(lines.size());
+
+        auto work = [&](std::size_t begin, std::size_t end) {
+            for (auto i = begin; i < end; ++i) {
+                auto log = model.prepare(lines[i]);
+                auto cluster = model.nearest(index, log.tokens);
+                if (cluster) {
+                    log.tokens.clear();
+                }
+                assignments[i] = Assignment{cluster, std::move(log)};
+            }
+        };
+
+        const auto chunk = (lines.size() + threads - 1) / threads;
+        std::vector<std::thread> workers;
+        for (std::size_t begin = chunk; begin < lines.size(); begin += chunk) {
+            workers.emplace_back(work, begin, std::min(begin + chunk, lines.size()));
+        }
+        work(0, std::min(chunk, lines.size()));
+        for (auto& worker : workers) {
+            worker.join();
+        }
+
+        std::vector<std::size_t> ids;
+        ids.reserve(lines.size());
+        for (auto& assignment : assignments) {
+            if (assignment.cluster) {
+                model.add_to(*assignment.cluster, assignment.log.timestamp);
+                ids.push_back(*assignment.cluster);
+                ++assigned_;
+            } else {
+                ids.push_back(model.add(assignment.log, index));
+                ++unmatched_;
+            }
+        }
+        frozen = model.cluster_count();
+
+        return ids;
+    }
+
+    // Lines clustered in full during the first phase
+    [[nodiscard]] auto sampled() const -> std::size_t {
+        return sampled_;
+    }
+
+    // Lines matched to a frozen cluster
+    [[nodiscard]] auto assigned() const -> std::size_t {
+        return assigned_;
+    }
+
+    // Lines that matched no frozen cluster and took the slow path
+    [[nodiscard]] auto unmatched() const -> std::size_t {
+        return unmatched_;
+    }
+};
+
+// Indexes of n lines picked uniformly from count lines (Algorithm R),
+// returned in input order
+auto reservoir_sample(std::size_t count, std::size_t n, std::uint64_t seed = 0) -> std::vector<std::size_t> {
+    std::vector<std::size_t> reservoir;
+    reservoir.reserve(std::min(count, n));
+
+    std::mt19937_64 random{seed};
+    for (std::size_t i = 0; i < count; ++i) {
+        if (i < n) {
+            reservoir.push_back(i);
+        } else {
+            auto j = std::uniform_int_distribution<std::size_t>{0, i}(random);
+            if (j < n) {
+                reservoir[j] = i;
+            }
+        }
+    }
+
+    std::sort(reservoir.begin(), reservoir.end());
+    return reservoir;
+}
+
+// How far a two phase result is from clustering every line in full
+struct Divergence {
+    std::size_t clusters;
+    std::size_t full_clusters;
+    std::size_t lines;
+    // Share of lines, 0 to 1, that went to the full cluster most of the
+    // lines of their two phase cluster went to
+    double agreement;
+    // Adjusted Rand index of the two partitions, 1 when they are the same
+    // and around 0 when they agree no more than chance would
+    double adjusted_rand;
+};
+
+// Compares the cluster each line was given by two phase clustering with the
+// one it was given by full clustering, both in the same line order. Cluster
+// ids are only compared within each side.
+auto compare(const std::vector<std::size_t>& labels, const std::vector<std::size_t>& full_labels) -> Divergence {
+    if (labels.size() != full_labels.size()) {
+        throw std::invalid_argument{"both sides need a cluster for every line"};
+    }
+
+    // Lines per pair of clusters, and per full cluster
+    std::unordered_map<std::size_t, std::unordered_map<std::size_t, std::size_t>> table;
+    std::unordered_map<std::size_t, std::size_t> full_sizes;
+    for (std::size_t i = 0; i < labels.size(); ++i) {
+        ++table[labels[i]][full_labels[i]];
+        ++full_sizes[full_labels[i]];
+    }
+
+    auto pairs = [](std::size_t n) { return n * (n - 1) / 2.0; };
+
+    std::size_t agreeing = 0;
+    double together = 0;
+    double together_full = 0;
+    double together_both = 0;
+    for (const auto& [cluster, row] : table) {
+        std::size_t size = 0;
+        std::size_t majority = 0;
+        for (auto [full, count] : row) {
+            size += count;
+            majority = std::max(majority, count);
+            together_both += pairs(count);
+        }
+        agreeing += majority;
+        together += pairs(size);
+    }
+    for (auto [full, size] : full_sizes) {
+        together_full += pairs(size);
+    }
+
+    const auto lines = labels.size();
+    auto expected = lines > 1 ? together * together_full / pairs(lines) : 0.0;
+    auto best = (together + together_full) / 2;
+    auto adjusted_rand = best == expected ? 1.0 : (together_both - expected) / (best - expected);
+
+    return Divergence{table.size(), full_sizes.size(), lines, lines ? static_cast<double>(agreeing) / lines : 1.0, adjusted_rand};
+}
+
+#endif // SAMPLE_H
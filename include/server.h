@@ -0,0 +1,574 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <sstream>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "logmine.h"
+#include "protocol.h"
+
+// Latencies in power of two microsecond buckets, percentiles report the
+// upper bound of the bucket they fall in
+class LatencyHistogram {
+
+    std::array<std::uint64_t, 40> buckets{};
+    std::uint64_t count_ = 0;
+    double sum_us = 0;
+    double max_us = 0;
+
+public:
+    void add(double us) {
+        auto bucket = 0;
+        while (bucket + 1 < static_cast<int>(buckets.size()) && (1ull << bucket) < us) {
+            ++bucket;
+        }
+        ++buckets[bucket];
+        ++count_;
+        sum_us += us;
+        max_us = std::max(max_us, us);
+    }
+
+    [[nodiscard]] auto count() const -> std::uint64_t {
+        return count_;
+    }
+
+    [[nodiscard]] auto mean() const -> double {
+        return count_ ? sum_us / count_ : 0;
+    }
+
+    [[nodiscard]] auto max() const -> double {
+        return max_us;
+    }
+
+    [[nodiscard]] auto percentile(double p) const -> double {
+        std::uint64_t seen = 0;
+        for (std::size_t bucket = 0; bucket < buckets.size(); ++bucket) {
+            seen += buckets[bucket];
+            if (seen > 0 && seen >= p * count_) {
+                return std::min(static_cast<double>(1ull << bucket), max_us);
+            }
+        }
+        return max_us;
+    }
+};
+
+// Serves one shared Logmine to local processes over a Unix domain socket,
+// see protocol.h for the wire format.
+//
+// A single thread runs the epoll loop, reading requests and writing
+// responses. Batches of lines go to a pool of workers which tokenize them
+// and find their clusters under a shared lock on a ClusterIndex, then take
+// the exclusive lock only to count the matches and to add() the lines that
+// matched nothing, which also goes through the index. As with SampleAssign,
+// matched lines are counted without refining the cluster representative.
+// Lines without tokens are answered with no_cluster and left out of the
+// model, since each of them would otherwise become a cluster of its own.
+//
+// A stale socket left at the path is replaced, but the server refuses to
+// start over anything that isn't a socket or over a live server's socket,
+// and on exit only removes the socket it created.
+//
+// Each connection has at most one batch in flight. The socket isn't read
+// while a request is being served or its response written, and reading stops
+// as soon as a whole request is buffered, so a client that sends faster than
+// it reads is held up by the socket buffers rather than by server memory.
+// A client that shuts down its sending side still gets the responses to the
+// requests it sent before; the connection is closed once they are written.
+class Server {
+
+    using clock = std::chrono::steady_clock;
+
+    static constexpr std::uint64_t listen_id = 0;
+    static constexpr std::uint64_t wake_id = 1;
+
+    struct Connection {
+        int fd;
+        std::string in;
+        std::string out;
+        bool busy = false;
+        // The client has shut down its sending side
+        bool eof = false;
+        // Events the connection is currently watched for
+        std::uint32_t events = EPOLLIN | EPOLLRDHUP;
+    };
+
+    struct Job {
+        std::uint64_t connection;
+        std::vector<std::string> lines;
+        clock::time_point received;
+    };
+
+    struct Done {
+        std::uint64_t connection;
+        std::string response;
+    };
+
+    Logmine& model;
+    ClusterIndex index;
+    std::shared_mutex model_mutex;
+
+    std::string path;
+    // Identity of the socket file created by bind()
+    dev_t socket_dev = 0;
+    ino_t socket_ino = 0;
+    int listen_fd = -1;
+    int epoll_fd = -1;
+    int wake_fd = -1;
+
+    std::unordered_map<std::uint64_t, Connection> connections;
+    std::uint64_t next_id = wake_id + 1;
+
+    std::mutex jobs_mutex;
+    std::condition_variable jobs_ready;
+    std::deque<Job> jobs;
+    bool stopping = false;
+    std::vector<std::thread> workers;
+
+    std::mutex done_mutex;
+    std::vector<Done> done;
+
+    // Lifetime totals, and a latency histogram covering the time since the
+    // last stats request
+    std::mutex stats_mutex;
+    clock::time_point started = clock::now();
+    clock::time_point interval_started = clock::now();
+    std::uint64_t lines_ = 0;
+    std::uint64_t batches_ = 0;
+    std::uint64_t interval_lines = 0;
+    LatencyHistogram latency;
+
+public:
+    Server(Logmine& model, std::string path, unsigned threads = std::max(1u, std::thread::hardware_concurrency()))
+        : model{model}, index{model.build_index()}, path{std::move(path)} {
+
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (this->path.size() >= sizeof(address.sun_path)) {
+            throw std::invalid_argument{"socket path too long: " + this->path};
+        }
+        std::strcpy(address.sun_path, this->path.c_str());
+        remove_stale_socket(address);
+
+        listen_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listen_fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "socket");
+        }
+        if (::bind(listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+            throw std::system_error(errno, std::generic_category(), "bind " + this->path);
+        }
+        struct stat bound{};
+        if (::lstat(this->path.c_str(), &bound) == 0) {
+            socket_dev = bound.st_dev;
+            socket_ino = bound.st_ino;
+        }
+        if (::listen(listen_fd, SOMAXCONN) < 0) {
+            throw std::system_error(errno, std::generic_category(), "listen");
+        }
+
+        epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+        wake_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (epoll_fd < 0 || wake_fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "epoll");
+        }
+        watch(listen_fd, listen_id, EPOLLIN, EPOLL_CTL_ADD);
+        watch(wake_fd, wake_id, EPOLLIN, EPOLL_CTL_ADD);
+
+        for (unsigned i = 0; i < std::max(1u, threads); ++i) {
+            workers.emplace_back([this] { work(); });
+        }
+    }
+
+    Server(const Server&) = delete;
+    auto operator=(const Server&) -> Server& = delete;
+
+    ~Server() {
+        {
+            std::lock_guard lock{jobs_mutex};
+            stopping = true;
+        }
+        jobs_ready.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+
+        for (auto& [id, connection] : connections) {
+            ::close(connection.fd);
+        }
+        ::close(wake_fd);
+        ::close(epoll_fd);
+        ::close(listen_fd);
+
+        struct stat current{};
+        if (::lstat(path.c_str(), &current) == 0 && current.st_dev == socket_dev && current.st_ino == socket_ino) {
+            ::unlink(path.c_str());
+        }
+    }
+
+    // Runs the event loop until should_stop returns true, which is checked
+    // at least every 100ms
+    void run(const std::function<bool()>& should_stop) {
+        std::array<epoll_event, 64> events;
+        while (!should_stop()) {
+            auto n = ::epoll_wait(epoll_fd, events.data(), events.size(), 100);
+            for (auto i = 0; i < n; ++i) {
+                auto id = events[i].data.u64;
+                if (id == listen_id) {
+                    accept_all();
+                } else if (id == wake_id) {
+                    complete();
+                } else {
+                    handle(id, events[i].events);
+                }
+            }
+        }
+    }
+
+private:
+
+    // Removes a socket left behind by a server that is gone. Throws when the
+    // path holds anything else or a server still accepts connections on it.
+    void remove_stale_socket(const sockaddr_un& address) {
+        struct stat existing{};
+        if (::lstat(path.c_str(), &existing) < 0) {
+            if (errno == ENOENT) {
+                return;
+            }
+            throw std::system_error(errno, std::generic_category(), "stat " + path);
+        }
+        if (!S_ISSOCK(existing.st_mode)) {
+            throw std::runtime_error{path + " exists and is not a socket"};
+        }
+
+        int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "socket");
+        }
+        auto live = ::connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0;
+        ::close(fd);
+        if (live) {
+            throw std::runtime_error{"a server is already listening on " + path};
+        }
+        ::unlink(path.c_str());
+    }
+
+    // Throughput and latency as key value lines. Batch latency runs from
+    // the whole request being read to its response being ready and covers
+    // the time since the previous call. Only called on the event loop thread.
+    auto stats() -> std::string {
+        std::size_t clusters;
+        {
+            std::shared_lock lock{model_mutex};
+            clusters = model.cluster_count();
+        }
+
+        std::lock_guard lock{stats_mutex};
+        auto now = clock::now();
+        auto uptime = std::chrono::duration<double>(now - started).count();
+        auto interval = std::chrono::duration<double>(now - interval_started).count();
+
+        std::size_t buffered = 0;
+        for (const auto& [id, connection] : connections) {
+            buffered += connection.in.size() + connection.out.size();
+        }
+
+        std::ostringstream out;
+        out << "uptime_s " << uptime << '\n'
+            << "connections " << connections.size() << '\n'
+            << "buffered_bytes " << buffered << '\n'
+            << "clusters " << clusters << '\n'
+            << "lines " << lines_ << '\n'
+            << "batches " << batches_ << '\n'
+            << "lines_per_s " << (uptime > 0 ? lines_ / uptime : 0) << '\n'
+            << "interval_lines_per_s " << (interval > 0 ? interval_lines / interval : 0) << '\n'
+            << "batch_latency_us_mean " << latency.mean() << '\n'
+            << "batch_latency_us_p50 " << latency.percentile(0.5) << '\n'
+            << "batch_latency_us_p99 " << latency.percentile(0.99) << '\n'
+            << "batch_latency_us_max " << latency.max() << '\n';
+
+        interval_started = now;
+        interval_lines = 0;
+        latency = LatencyHistogram{};
+        return out.str();
+    }
+
+    void watch(int fd, std::uint64_t id, std::uint32_t events, int op) {
+        epoll_event event{};
+        event.events = events;
+        event.data.u64 = id;
+        if (::epoll_ctl(epoll_fd, op, fd, &event) < 0) {
+            throw std::system_error(errno, std::generic_category(), "epoll_ctl");
+        }
+    }
+
+    void accept_all() {
+        int fd;
+        while ((fd = ::accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+            auto id = next_id++;
+            auto [it, inserted] = connections.emplace(id, Connection{fd});
+            watch(fd, id, it->second.events, EPOLL_CTL_ADD);
+        }
+    }
+
+    void close_connection(std::uint64_t id) {
+        auto it = connections.find(id);
+        if (it == connections.end()) {
+            return;
+        }
+        ::epoll_ctl(epoll_fd, EPOLL_CTL_DEL, it->second.fd, nullptr);
+        ::close(it->second.fd);
+        connections.erase(it);
+    }
+
+    void handle(std::uint64_t id, std::uint32_t events) {
+        auto it = connections.find(id);
+        if (it == connections.end()) {
+            return;
+        }
+        auto& connection = it->second;
+
+        if (events & (EPOLLHUP | EPOLLERR)) {
+            // Gone in both directions, responses can't be delivered anymore
+            close_connection(id);
+            return;
+        }
+
+        if (events & EPOLLOUT) {
+            if (!flush(id, connection)) {
+                return;
+            }
+        }
+
+        dispatch(id, connection);
+    }
+
+    static auto idle(const Connection& connection) -> bool {
+        return !connection.busy && connection.out.empty();
+    }
+
+    // True once the buffer holds a whole request, or one that can't be valid
+    // and will close the connection
+    static auto has_request(const std::string& in) -> bool {
+        Frame frame{};
+        try {
+            return decode_frame(in, frame) > 0;
+        } catch (const std::exception&) {
+            return true;
+        }
+    }
+
+    // Reads until a whole request is buffered or the socket has nothing
+    // more, returns false when the connection had to be closed
+    auto receive(std::uint64_t id, Connection& connection) -> bool {
+        char buf[65536];
+        while (!connection.eof && !has_request(connection.in)) {
+            auto n = ::read(connection.fd, buf, sizeof(buf));
+            if (n > 0) {
+                connection.in.append(buf, n);
+            } else if (n == 0) {
+                connection.eof = true;
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            } else {
+                close_connection(id);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Starts on the next request once the connection is idle, reading it
+    // first if needed, and closes the connection when the client has stopped
+    // sending and every response has been written
+    void dispatch(std::uint64_t id, Connection& connection) {
+        while (idle(connection)) {
+            if (!receive(id, connection)) {
+                return;
+            }
+
+            Frame frame{};
+            std::size_t used;
+            std::vector<std::string> lines;
+            try {
+                used = decode_frame(connection.in, frame);
+                if (used == 0) {
+                    if (connection.eof) {
+                        close_connection(id);
+                        return;
+                    }
+                    break;
+                }
+                if (frame.type == MessageType::Lines) {
+                    lines = decode_lines(frame.body);
+                } else if (frame.type != MessageType::Stats) {
+                    throw std::runtime_error{"unexpected message"};
+                }
+            } catch (const std::exception&) {
+                close_connection(id);
+                return;
+            }
+            connection.in.erase(0, used);
+
+            if (frame.type == MessageType::Stats) {
+                connection.out = encode_stats(stats());
+            } else {
+                connection.busy = true;
+                {
+                    std::lock_guard lock{jobs_mutex};
+                    jobs.push_back(Job{id, std::move(lines), clock::now()});
+                }
+                jobs_ready.notify_one();
+            }
+
+            if (!flush(id, connection)) {
+                return;
+            }
+        }
+        update_watch(id, connection);
+    }
+
+    // Watches for input only while the connection is idle and for output
+    // only while a response is waiting to be written
+    void update_watch(std::uint64_t id, Connection& connection) {
+        std::uint32_t events = 0;
+        if (idle(connection) && !connection.eof) {
+            events |= EPOLLIN | EPOLLRDHUP;
+        }
+        if (!connection.out.empty()) {
+            events |= EPOLLOUT;
+        }
+        if (events != connection.events) {
+            connection.events = events;
+            watch(connection.fd, id, events, EPOLL_CTL_MOD);
+        }
+    }
+
+    // Writes as much of the pending response as the socket takes, returns
+    // false when the connection had to be closed
+    auto flush(std::uint64_t id, Connection& connection) -> bool {
+        std::size_t written = 0;
+        while (written < connection.out.size()) {
+            auto n = ::send(connection.fd, connection.out.data() + written, connection.out.size() - written, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    break;
+                }
+                close_connection(id);
+                return false;
+            }
+            written += n;
+        }
+        connection.out.erase(0, written);
+        return true;
+    }
+
+    void complete() {
+        std::uint64_t count;
+        while (::read(wake_fd, &count, sizeof(count)) > 0) {
+        }
+
+        std::vector<Done> finished;
+        {
+            std::lock_guard lock{done_mutex};
+            finished.swap(done);
+        }
+
+        for (auto& response : finished) {
+            auto it = connections.find(response.connection);
+            if (it == connections.end()) {
+                // Closed while its batch was being processed
+                continue;
+            }
+            auto& connection = it->second;
+            connection.busy = false;
+            connection.out += response.response;
+            if (flush(response.connection, connection)) {
+                dispatch(response.connection, connection);
+            }
+        }
+    }
+
+    void work() {
+        while (true) {
+            Job job;
+            {
+                std::unique_lock lock{jobs_mutex};
+                jobs_ready.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (jobs.empty()) {
+                    return;
+                }
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+
+            auto response = encode_ids(ingest(job.lines));
+            auto us = std::chrono::duration<double, std::micro>(clock::now() - job.received).count();
+
+            {
+                std::lock_guard lock{stats_mutex};
+                lines_ += job.lines.size();
+                interval_lines += job.lines.size();
+                ++batches_;
+                latency.add(us);
+            }
+            {
+                std::lock_guard lock{done_mutex};
+                done.push_back(Done{job.connection, std::move(response)});
+            }
+            std::uint64_t one = 1;
+            ::write(wake_fd, &one, sizeof(one));
+        }
+    }
+
+    auto ingest(const std::vector<std::string>& lines) -> std::vector<std::uint32_t> {
+        std::vector<TokenizedLog> logs;
+        logs.reserve(lines.size());
+        for (const auto& line : lines) {
+            logs.push_back(model.prepare(line));
+        }
+
+        std::vector<std::optional<std::size_t>> found(logs.size());
+        {
+            std::shared_lock lock{model_mutex};
+            for (std::size_t i = 0; i < logs.size(); ++i) {
+                if (!logs[i].tokens.empty()) {
+                    found[i] = model.nearest(index, logs[i].tokens);
+                }
+            }
+        }
+
+        std::vector<std::uint32_t> ids(logs.size());
+        std::unique_lock lock{model_mutex};
+        for (std::size_t i = 0; i < logs.size(); ++i) {
+            if (logs[i].tokens.empty()) {
+                ids[i] = no_cluster;
+            } else if (found[i]) {
+                model.add_to(*found[i], logs[i].timestamp);
+                ids[i] = *found[i];
+            } else {
+                // Another batch may have created a match since, the index
+                // covers every cluster so add() finds it without a full scan
+                ids[i] = model.add(logs[i], index);
+            }
+        }
+        return ids;
+    }
+};
+
+#endif // SERVER_H
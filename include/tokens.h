@@ -6,6 +6,11 @@
 #include <sstream>
 #include <ostream>
 #include <regex>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
 
 enum class Tokens {Text, Gap, Word, Date, Time, DateTime};
 
@@ -34,6 +39,15 @@ auto token_to_str(const Tokens& token) -> std::string {
     return "Unknown";
 }
 
+auto str_to_token(const std::string& str) -> Tokens {
+    for (auto token : {Tokens::Text, Tokens::Gap, Tokens::Word, Tokens::Date, Tokens::Time, Tokens::DateTime}) {
+        if (token_to_str(token) == str) {
+            return token;
+        }
+    }
+    throw std::invalid_argument{"unknown token type: " + str};
+}
+
 class Token {
 
     std::string _str;
@@ -41,8 +55,8 @@ class Token {
 
 public:
     Token(std::string str, Tokens tokenType) : _str(std::move(str)), _tokenType(tokenType) {}
-    auto to_str() -> std::string { return _str; }
-    auto token_type() -> Tokens { return _tokenType; }
+    auto to_str() const -> const std::string& { return _str; }
+    auto token_type() const -> Tokens { return _tokenType; }
 
     auto operator==(const Token& other) const -> bool {
         return _str == other._str && _tokenType == other._tokenType;
@@ -74,7 +88,12 @@ public:
     DateToken(const std::string str = "Date") : Token{str, Tokens::Date} {}
 
     static auto isa(const std::string& str) -> bool {
-        return std::regex_match(str, std::regex{date_regex});
+        // Most tokens can be ruled out by their shape before running the regex
+        if (str.size() != 10 || str[4] != '-') {
+            return false;
+        }
+        static const std::regex re{date_regex};
+        return std::regex_match(str, re);
     }
 };
 const std::string DateToken::date_regex{R"(\d{4}-\d{2}-\d{2})"};
@@ -86,7 +105,11 @@ public:
     TimeToken(const std::string str = "Time") : Token{str, Tokens::Time} {}
 
     static auto isa(const std::string& str) -> bool {
-        return std::regex_match(str, std::regex{time_regex});
+        if (str.size() != 12 || str[2] != ':') {
+            return false;
+        }
+        static const std::regex re{time_regex};
+        return std::regex_match(str, re);
     }
 };
 const std::string TimeToken::time_regex{R"(\d{2}:\d{2}:\d{2},\d{3})"};
@@ -99,24 +122,78 @@ public:
     DateTimeToken(const std::string str = "DateTime") : Token{str, Tokens::DateTime} {}
 
     static auto isa(const std::string& str) -> bool {
-        return std::regex_match(str, std::regex{date_time_regex});
+        if (str.size() != 19 || str[10] != 'T') {
+            return false;
+        }
+        static const std::regex re{date_time_regex};
+        return std::regex_match(str, re);
     }
 };
 const std::string DateTimeToken::date_time_regex{R"(20\d{2}-(0[1-9]|1[0-2])-[0-3]\dT([0-1][0-9]|2[0-3]):[0-5]\d:[0-5]\d)"};
 
-auto tokenize(std::string str) -> std::vector<Token> {
+// The parsers below only see strings that already matched the corresponding
+// token regex so they can read the digits by position
+
+auto digits(const std::string& str, std::size_t pos, std::size_t len) -> int {
+    auto n = 0;
+    for (auto i = pos; i < pos + len; ++i) {
+        n = n * 10 + (str[i] - '0');
+    }
+    return n;
+}
+
+// Seconds since the Unix epoch of midnight UTC for a yyyy-mm-dd date
+auto parse_date(const std::string& str) -> std::int64_t {
+    using namespace std::chrono;
+    auto day = sys_days{year{digits(str, 0, 4)} / digits(str, 5, 2) / digits(str, 8, 2)};
+    return duration_cast<seconds>(day.time_since_epoch()).count();
+}
+
+// Seconds since midnight for a hh:mm:ss time
+auto parse_time(const std::string& str, std::size_t pos = 0) -> std::int64_t {
+    return digits(str, pos, 2) * 3600 + digits(str, pos + 3, 2) * 60 + digits(str, pos + 6, 2);
+}
+
+// When timestamp is given it receives the first DateTime, or Date followed
+// by Time, found in the log in seconds since the Unix epoch and is left
+// untouched when the log has none
+auto tokenize(const std::string& str, std::int64_t* timestamp = nullptr) -> std::vector<Token> {
 
-    std::istringstream to_tokenize{str};
     std::string str1;
     std::vector<Token> tokens;
 
-    while(to_tokenize >> str1) {
+    auto found_timestamp = timestamp == nullptr;
+    std::int64_t date = -1;
+
+    // Splits on whitespace like reading from an istringstream would, without
+    // the stream overhead
+    auto is_space = [](char c) { return std::isspace(static_cast<unsigned char>(c)) != 0; };
+    for (auto it = str.begin(); it != str.end(); ) {
+        it = std::find_if_not(it, str.end(), is_space);
+        if (it == str.end()) {
+            break;
+        }
+        auto end = std::find_if(it, str.end(), is_space);
+        str1.assign(it, end);
+        it = end;
+
         if (DateToken::isa(str1)) {
             tokens.push_back(DateToken{});
+            if (!found_timestamp) {
+                date = parse_date(str1);
+            }
         } else if (TimeToken::isa(str1)) {
             tokens.push_back(TimeToken{});
+            if (!found_timestamp && date >= 0) {
+                *timestamp = date + parse_time(str1);
+                found_timestamp = true;
+            }
         } else if (DateTimeToken::isa(str1)) {
             tokens.push_back(DateTimeToken{});
+            if (!found_timestamp) {
+                *timestamp = parse_date(str1) + parse_time(str1, 11);
+                found_timestamp = true;
+            }
         } else {
             tokens.push_back(Text{str1});
         }
@@ -1,5 +1,13 @@
 #include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <fstream>
 #include "logmine.h"
+#include "follow.h"
+#include "sample.h"
+#include "server.h"
 // #include "rapidjson/document.h"
 #include "sajson.h"
 
@@ -11,8 +19,326 @@ auto success(const sajson::document& doc) -> bool {
     return true;
 }
 
+volatile std::sig_atomic_t stop = 0;
+
+auto usage() -> int {
+    std::cerr << "usage: logmine --follow [--interval-ms N] [--from-start] FILE...\n"
+              << "       logmine --build MODEL [FILE...]\n"
+              << "       logmine --merge MODEL INPUT_MODEL...\n"
+              << "       logmine --sample N [--threads T] [--compare] FILE...\n"
+              << "       logmine --serve SOCKET [--threads T] [--model MODEL]" << std::endl;
+    return 2;
+}
+
+void print_snapshot(std::ostream& out, std::vector<ClusterDelta> deltas, std::size_t lines, std::size_t clusters, double latency_avg_us, double latency_max_us) {
+    out << "interval lines: " << lines << ", clusters: " << clusters
+        << ", latency avg: " << latency_avg_us << "us, max: " << latency_max_us << "us" << std::endl;
+
+    std::sort(deltas.begin(), deltas.end(), [](const ClusterDelta& a, const ClusterDelta& b) { return a.hits > b.hits; });
+    for (auto& delta : deltas) {
+        auto marker = delta.is_new ? '+' : delta.rep_changed ? '~' : ' ';
+        out << marker << " [" << delta.index << "] hits: " << delta.hits << ", size: " << delta.size << ", id: " << delta.id << std::endl;
+    }
+    out.flush();
+}
+
+// Tails the given files and prints what changed in the model every interval.
+// Latency is measured from the moment the follower wakes up with new data to
+// the moment the line's cluster has been updated.
+auto follow(const std::vector<std::string>& paths, int interval_ms, bool from_start) -> int {
+    using clock = std::chrono::steady_clock;
+
+    Logmine model;
+    Follower follower{paths, from_start};
+
+    std::signal(SIGINT, [](int) { stop = 1; });
+    std::signal(SIGTERM, [](int) { stop = 1; });
+
+    std::size_t lines = 0;
+    double latency_sum_us = 0;
+    double latency_max_us = 0;
+
+    auto deadline = clock::now() + std::chrono::milliseconds(interval_ms);
+    while (!stop) {
+        auto timeout = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - clock::now()).count();
+        follower.wait(std::max<int>(0, timeout));
+
+        auto woke = clock::now();
+        follower.read([&](const std::string& line) {
+            // Blank lines can't match anything and would each add a cluster
+            auto log = model.prepare(line);
+            if (log.tokens.empty()) {
+                return;
+            }
+            model.add(log);
+            ++lines;
+
+            auto us = std::chrono::duration<double, std::micro>(clock::now() - woke).count();
+            latency_sum_us += us;
+            latency_max_us = std::max(latency_max_us, us);
+        });
+
+        if (clock::now() >= deadline || stop) {
+            print_snapshot(std::cout, model.snapshot(), lines, model.cluster_count(), lines ? latency_sum_us / lines : 0, latency_max_us);
+            lines = 0;
+            latency_sum_us = 0;
+            latency_max_us = 0;
+            deadline = clock::now() + std::chrono::milliseconds(interval_ms);
+        }
+    }
+
+    return 0;
+}
+
+auto save(const Logmine& model, const std::string& path) -> int {
+    std::ofstream out{path};
+    model.save(out);
+    out.close();
+    if (!out) {
+        std::cerr << "failed to write " << path << std::endl;
+        return 1;
+    }
+    std::cout << path << ": " << model.cluster_count() << " clusters" << std::endl;
+    return 0;
+}
+
+// Clusters the lines of the given files, or stdin, and writes the model
+auto build(const std::string& model_path, const std::vector<std::string>& paths) -> int {
+    Logmine model;
+
+    auto add_lines = [&](std::istream& in) {
+        std::string line;
+        while (std::getline(in, line)) {
+            model.add(line);
+        }
+    };
+
+    if (paths.empty()) {
+        add_lines(std::cin);
+    }
+    for (const auto& path : paths) {
+        std::ifstream in{path};
+        if (!in.is_open()) {
+            std::cerr << "failed to open " << path << std::endl;
+            return 1;
+        }
+        add_lines(in);
+    }
+
+    return save(model, model_path);
+}
+
+// Folds models written by --build, or by earlier merges, into one
+auto merge_models(const std::string& model_path, const std::vector<std::string>& paths) -> int {
+    Logmine model;
+    for (const auto& path : paths) {
+        std::ifstream in{path};
+        if (!in.is_open()) {
+            std::cerr << "failed to open " << path << std::endl;
+            return 1;
+        }
+        try {
+            model.merge(Logmine::load(in));
+        } catch (const std::exception& e) {
+            std::cerr << path << ": " << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    return save(model, model_path);
+}
+
+void print_clusters(std::ostream& out, const Logmine& model) {
+    std::vector<const Cluster*> clusters;
+    for (std::size_t i = 0; i < model.cluster_count(); ++i) {
+        clusters.push_back(&model.get_cluster(i));
+    }
+    std::sort(clusters.begin(), clusters.end(), [](const Cluster* a, const Cluster* b) { return a->size() > b->size(); });
+    for (auto cluster : clusters) {
+        out << "size: " << cluster->size() << ", id: " << cluster->id() << std::endl;
+    }
+}
+
+// Clusters the first sample_size lines in full, then assigns the rest to the
+// frozen clusters in batches. With compare the files are clustered a second
+// time in full to report the difference and the speedup.
+auto sample(const std::vector<std::string>& paths, std::size_t sample_size, unsigned threads, bool compare_full) -> int {
+    using clock = std::chrono::steady_clock;
+    const std::size_t batch_size = 65536;
+
+    auto start = clock::now();
+
+    Logmine model;
+    SampleAssign two_phase{model, threads};
+
+    // The cluster of every line, only kept for the comparison
+    std::vector<std::size_t> labels;
+    auto keep = [&](const std::vector<std::size_t>& ids) {
+        if (compare_full) {
+            labels.insert(labels.end(), ids.begin(), ids.end());
+        }
+    };
+
+    std::vector<std::string> batch;
+    for (const auto& path : paths) {
+        std::ifstream in{path};
+        if (!in.is_open()) {
+            std::cerr << "failed to open " << path << std::endl;
+            return 1;
+        }
+
+        std::string line;
+        while (std::getline(in, line)) {
+            batch.push_back(std::move(line));
+            if (two_phase.sampled() == 0 && batch.size() == sample_size) {
+                keep(two_phase.fit(batch));
+                batch.clear();
+            } else if (two_phase.sampled() > 0 && batch.size() == batch_size) {
+                keep(two_phase.assign(batch));
+                batch.clear();
+            }
+        }
+    }
+    if (two_phase.sampled() == 0) {
+        keep(two_phase.fit(batch));
+    } else {
+        keep(two_phase.assign(batch));
+    }
+
+    auto elapsed = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+
+    print_clusters(std::cout, model);
+    std::cout << "sampled: " << two_phase.sampled() << ", assigned: " << two_phase.assigned()
+              << ", unmatched: " << two_phase.unmatched() << ", time: " << elapsed << "ms" << std::endl;
+
+    if (!compare_full) {
+        return 0;
+    }
+
+    start = clock::now();
+    Logmine full;
+    std::vector<std::size_t> full_labels;
+    full_labels.reserve(labels.size());
+    for (const auto& path : paths) {
+        std::ifstream in{path};
+        std::string line;
+        while (std::getline(in, line)) {
+            full_labels.push_back(full.add(line));
+        }
+    }
+    auto full_elapsed = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+
+    auto divergence = compare(labels, full_labels);
+    std::cout << "full clustering clusters: " << divergence.full_clusters << ", two phase clusters: " << divergence.clusters
+              << ", agreement: " << divergence.agreement << ", adjusted rand: " << divergence.adjusted_rand
+              << ", full time: " << full_elapsed << "ms"
+              << ", speedup: " << full_elapsed / elapsed << "x" << std::endl;
+
+    return 0;
+}
+
+// Serves one shared model on a Unix domain socket until interrupted. With a
+// model file the model is loaded from it on start and written back on exit.
+auto serve(const std::string& socket_path, unsigned threads, const std::string& model_path) -> int {
+    Logmine model;
+    if (!model_path.empty()) {
+        std::ifstream in{model_path};
+        if (in.is_open()) {
+            try {
+                model = Logmine::load(in);
+            } catch (const std::exception& e) {
+                std::cerr << model_path << ": " << e.what() << std::endl;
+                return 1;
+            }
+        }
+    }
+
+    std::signal(SIGINT, [](int) { stop = 1; });
+    std::signal(SIGTERM, [](int) { stop = 1; });
+    std::signal(SIGPIPE, SIG_IGN);
+
+    try {
+        Server server{model, socket_path, threads};
+        std::cerr << "serving " << model.cluster_count() << " clusters on " << socket_path << std::endl;
+        server.run([] { return stop != 0; });
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    if (!model_path.empty()) {
+        return save(model, model_path);
+    }
+    return 0;
+}
+
 auto main(int argc, char* argv[]) -> int {
 
+    if (argc > 2 && std::strcmp(argv[1], "--serve") == 0) {
+        auto threads = std::max(1u, std::thread::hardware_concurrency());
+        std::string model_path;
+        for (auto i = 3; i < argc; ++i) {
+            if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+                threads = std::max(1, std::atoi(argv[++i]));
+            } else if (std::strcmp(argv[i], "--model") == 0 && i + 1 < argc) {
+                model_path = argv[++i];
+            } else {
+                return usage();
+            }
+        }
+        return serve(argv[2], threads, model_path);
+    }
+
+    if (argc > 2 && std::strcmp(argv[1], "--sample") == 0) {
+        auto sample_size = std::atol(argv[2]);
+        auto threads = std::max(1u, std::thread::hardware_concurrency());
+        auto compare_full = false;
+        std::vector<std::string> paths;
+        for (auto i = 3; i < argc; ++i) {
+            if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+                threads = std::max(1, std::atoi(argv[++i]));
+            } else if (std::strcmp(argv[i], "--compare") == 0) {
+                compare_full = true;
+            } else {
+                paths.emplace_back(argv[i]);
+            }
+        }
+        if (paths.empty() || sample_size <= 0) {
+            return usage();
+        }
+        return sample(paths, sample_size, threads, compare_full);
+    }
+
+    if (argc > 2 && (std::strcmp(argv[1], "--build") == 0 || std::strcmp(argv[1], "--merge") == 0)) {
+        std::vector<std::string> paths{argv + 3, argv + argc};
+        if (std::strcmp(argv[1], "--build") == 0) {
+            return build(argv[2], paths);
+        }
+        if (paths.empty()) {
+            return usage();
+        }
+        return merge_models(argv[2], paths);
+    }
+
+    if (argc > 1 && std::strcmp(argv[1], "--follow") == 0) {
+        auto interval_ms = 1000;
+        auto from_start = false;
+        std::vector<std::string> paths;
+        for (auto i = 2; i < argc; ++i) {
+            if (std::strcmp(argv[i], "--interval-ms") == 0 && i + 1 < argc) {
+                interval_ms = std::atoi(argv[++i]);
+            } else if (std::strcmp(argv[i], "--from-start") == 0) {
+                from_start = true;
+            } else {
+                paths.emplace_back(argv[i]);
+            }
+        }
+        if (paths.empty() || interval_ms <= 0) {
+            return usage();
+        }
+        return follow(paths, interval_ms, from_start);
+    }
+
     auto logs = std::string{R"([
         { "message": "2020-09-06T16:00:00 Disconnected from broker broker1" },
         { "message": "2020-09-06T16:00:00 Disconnected from broker broker2" },
@@ -0,0 +1,184 @@
+// Load generator for `logmine --serve`. Replays the lines of a file in
+// batches over several connections for a fixed time and reports throughput,
+// round trip latency and the server's own stats.
+
+#include <iostream>
+#include <fstream>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+#include "client.h"
+
+using steady = std::chrono::steady_clock;
+
+auto usage() -> int {
+    std::cerr << "usage: logmine_client SOCKET FILE [--connections N] [--batch N] [--depth N] [--seconds N]\n"
+              << "       logmine_client SOCKET --stats" << std::endl;
+    return 2;
+}
+
+// Like read_frame() but treats the server closing the connection as an error
+auto expect_frame(int fd, std::string& buffer) -> std::pair<MessageType, std::string> {
+    auto frame = read_frame(fd, buffer);
+    if (!frame) {
+        throw std::runtime_error{"connection closed"};
+    }
+    return std::move(*frame);
+}
+
+auto fetch_stats(const std::string& path) -> std::string {
+    int fd = connect_to(path);
+    write_all(fd, encode_stats());
+    std::string buffer;
+    auto [type, body] = expect_frame(fd, buffer);
+    ::close(fd);
+    return body;
+}
+
+struct Result {
+    std::uint64_t lines = 0;
+    std::vector<double> latencies_us;
+};
+
+// One connection keeping `depth` batches in flight until the deadline
+auto run_connection(const std::string& path, const std::vector<std::string>& lines, std::size_t offset,
+                    std::size_t batch_size, std::size_t depth, steady::time_point deadline) -> Result {
+    Result result;
+    int fd = connect_to(path);
+    std::string buffer;
+    std::deque<std::pair<steady::time_point, std::size_t>> in_flight;
+
+    auto next = offset % lines.size();
+    auto send = [&]() {
+        std::vector<std::string_view> batch;
+        batch.reserve(batch_size);
+        for (std::size_t i = 0; i < batch_size; ++i) {
+            batch.emplace_back(lines[next]);
+            next = (next + 1) % lines.size();
+        }
+        in_flight.emplace_back(steady::now(), batch.size());
+        write_all(fd, encode_lines(batch));
+    };
+
+    for (std::size_t i = 0; i < depth; ++i) {
+        send();
+    }
+
+    while (!in_flight.empty()) {
+        auto [type, body] = expect_frame(fd, buffer);
+        auto ids = decode_ids(body);
+
+        auto [sent, size] = in_flight.front();
+        in_flight.pop_front();
+        if (ids.size() != size) {
+            throw std::runtime_error{"response doesn't match request"};
+        }
+        result.latencies_us.push_back(std::chrono::duration<double, std::micro>(steady::now() - sent).count());
+        result.lines += size;
+
+        if (steady::now() < deadline) {
+            send();
+        }
+    }
+
+    ::close(fd);
+    return result;
+}
+
+auto main(int argc, char* argv[]) -> int {
+
+    if (argc == 3 && std::strcmp(argv[2], "--stats") == 0) {
+        try {
+            std::cout << fetch_stats(argv[1]);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+    if (argc < 3) {
+        return usage();
+    }
+
+    std::size_t connections = 4;
+    std::size_t batch_size = 1000;
+    std::size_t depth = 2;
+    auto seconds = 5.0;
+    for (auto i = 3; i + 1 < argc; i += 2) {
+        if (std::strcmp(argv[i], "--connections") == 0) {
+            connections = std::max(1, std::atoi(argv[i + 1]));
+        } else if (std::strcmp(argv[i], "--batch") == 0) {
+            batch_size = std::max(1, std::atoi(argv[i + 1]));
+        } else if (std::strcmp(argv[i], "--depth") == 0) {
+            depth = std::max(1, std::atoi(argv[i + 1]));
+        } else if (std::strcmp(argv[i], "--seconds") == 0) {
+            seconds = std::atof(argv[i + 1]);
+        } else {
+            return usage();
+        }
+    }
+
+    std::vector<std::string> lines;
+    std::ifstream in{argv[2]};
+    std::string line;
+    while (std::getline(in, line)) {
+        lines.push_back(line);
+    }
+    if (lines.empty()) {
+        std::cerr << "no lines in " << argv[2] << std::endl;
+        return 1;
+    }
+
+    auto start = steady::now();
+    auto deadline = start + std::chrono::duration_cast<steady::duration>(std::chrono::duration<double>(seconds));
+
+    std::vector<Result> results(connections);
+    std::atomic<bool> failed{false};
+    std::vector<std::thread> threads;
+    for (std::size_t c = 0; c < connections; ++c) {
+        threads.emplace_back([&, c] {
+            try {
+                results[c] = run_connection(argv[1], lines, c * lines.size() / connections, batch_size, depth, deadline);
+            } catch (const std::exception& e) {
+                std::cerr << e.what() << std::endl;
+                failed = true;
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    auto elapsed = std::chrono::duration<double>(steady::now() - start).count();
+
+    if (failed) {
+        return 1;
+    }
+
+    std::uint64_t total = 0;
+    std::vector<double> latencies;
+    for (auto& result : results) {
+        total += result.lines;
+        latencies.insert(latencies.end(), result.latencies_us.begin(), result.latencies_us.end());
+    }
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p) { return latencies.empty() ? 0 : latencies[std::min(latencies.size() - 1, static_cast<std::size_t>(p * latencies.size()))]; };
+
+    std::cout << "connections " << connections << ", batch " << batch_size << ", depth " << depth << '\n'
+              << "lines " << total << " in " << elapsed << "s, " << total / elapsed << " lines/s\n"
+              << "batch round trip us p50 " << percentile(0.5) << ", p99 " << percentile(0.99)
+              << ", max " << (latencies.empty() ? 0 : latencies.back()) << std::endl;
+
+    try {
+        std::cout << "server:\n" << fetch_stats(argv[1]);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
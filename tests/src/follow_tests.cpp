@@ -0,0 +1,95 @@
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include "follow.h"
+
+#include <cstdio>
+#include <fstream>
+#include <stdlib.h>
+
+auto temp_dir() -> std::string {
+    char dir[] = "/tmp/follow_testsXXXXXX";
+    REQUIRE(mkdtemp(dir) != nullptr);
+    return dir;
+}
+
+void append(const std::string& path, const std::string& data) {
+    std::ofstream out{path, std::ios::app};
+    out << data;
+}
+
+auto read_lines(Follower& follower) -> std::vector<std::string> {
+    std::vector<std::string> lines;
+    follower.poll(0, [&](const std::string& line) { lines.push_back(line); });
+    return lines;
+}
+
+TEST_CASE( "should only read appended lines", "[follow]" ) {
+    auto dir = temp_dir();
+    auto path = dir + "/app.log";
+    append(path, "old line\n");
+
+    Follower follower{{path}};
+    REQUIRE(read_lines(follower).empty());
+
+    append(path, "first\nsecond\n");
+    REQUIRE(read_lines(follower) == std::vector<std::string>{"first", "second"});
+    REQUIRE(read_lines(follower).empty());
+}
+
+TEST_CASE( "should hold back partial lines until they are complete", "[follow]" ) {
+    auto dir = temp_dir();
+    auto path = dir + "/app.log";
+    append(path, "");
+
+    Follower follower{{path}};
+
+    append(path, "half a ");
+    REQUIRE(read_lines(follower).empty());
+
+    append(path, "line\r\n");
+    REQUIRE(read_lines(follower) == std::vector<std::string>{"half a line"});
+}
+
+TEST_CASE( "should follow a file across rename rotation", "[follow]" ) {
+    auto dir = temp_dir();
+    auto path = dir + "/app.log";
+    append(path, "");
+
+    Follower follower{{path}};
+
+    append(path, "before rotation\nunterminated");
+    REQUIRE(std::rename(path.c_str(), (path + ".1").c_str()) == 0);
+    append(path, "after rotation\n");
+
+    REQUIRE(read_lines(follower) == std::vector<std::string>{"before rotation", "unterminated", "after rotation"});
+
+    append(path, "next\n");
+    REQUIRE(read_lines(follower) == std::vector<std::string>{"next"});
+}
+
+TEST_CASE( "should follow a file across copy truncate rotation", "[follow]" ) {
+    auto dir = temp_dir();
+    auto path = dir + "/app.log";
+    append(path, "");
+
+    Follower follower{{path}};
+
+    append(path, "a fairly long line before truncation\n");
+    REQUIRE(read_lines(follower).size() == 1);
+
+    std::ofstream{path, std::ios::trunc} << "short\n";
+    REQUIRE(read_lines(follower) == std::vector<std::string>{"short"});
+}
+
+TEST_CASE( "should pick up a file created after starting", "[follow]" ) {
+    auto dir = temp_dir();
+    auto path = dir + "/late.log";
+
+    Follower follower{{path}};
+    REQUIRE(read_lines(follower).empty());
+
+    append(path, "hello\n");
+    REQUIRE(follower.wait(1000));
+    REQUIRE(read_lines(follower) == std::vector<std::string>{"hello"});
+}
@@ -0,0 +1,139 @@
+#define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include "catch2/catch.hpp"
+
+#include "logmine.h"
+#include "sample.h"
+#include "logs.h"
+
+#include <sstream>
+
+// Builds a saved model with one cluster per pattern in [first, last). Going
+// through load() keeps the setup cheap, add() would be quadratic here.
+//
+// Every cluster shares Date, Time and INFO and has its own token in each
+// other position, the index's best case: the shared postings are never
+// scanned. With shared_word four in five clusters also hold WORD at the
+// fourth of their eight positions. Two clusters still share at most half of
+// their tokens and never match, but a fifth equal position is needed for a
+// match so the long WORD posting list has to be scanned.
+auto synthetic_model(int first, int last, bool shared_word = false) -> Logmine {
+    std::stringstream saved;
+    saved << "logmine 1 " << (last - first) << '\n';
+    for (auto i = first; i < last; ++i) {
+        saved << 10 << (shared_word ? " 8" : " 7") << " Date:Date Time:Time Text:INFO";
+        if (shared_word) {
+            saved << (i % 5 ? " Text:WORD" : " Text:host" + std::to_string(i));
+        }
+        saved << " Text:worker" << i << " Text:job" << i << " Text:code" << i << " Text:state" << i
+              << " " << 1599408000 + i << ' ' << 1599408000 + i << " 0 0 0\n";
+    }
+    return Logmine::load(saved);
+}
+
+TEST_CASE( "merge models with 10k clusters each", "[merge]" ) {
+    const auto left = synthetic_model(0, 10000);
+    const auto right = synthetic_model(5000, 15000);
+
+    auto merged = left;
+    merged.merge(right);
+    REQUIRE(merged.cluster_count() == 15000);
+
+    BENCHMARK_ADVANCED("merge 10k + 10k, half overlapping")(Catch::Benchmark::Chronometer meter) {
+        std::vector<Logmine> models(meter.runs(), left);
+        meter.measure([&](int i) { models[i].merge(right); });
+    };
+
+    const auto big_left = synthetic_model(0, 20000);
+    const auto big_right = synthetic_model(10000, 30000);
+
+    BENCHMARK_ADVANCED("merge 20k + 20k, half overlapping")(Catch::Benchmark::Chronometer meter) {
+        std::vector<Logmine> models(meter.runs(), big_left);
+        meter.measure([&](int i) { models[i].merge(big_right); });
+    };
+}
+
+TEST_CASE( "merge models whose clusters share a token", "[merge]" ) {
+    const auto left = synthetic_model(0, 10000, true);
+    const auto right = synthetic_model(5000, 15000, true);
+
+    auto merged = left;
+    merged.merge(right);
+    REQUIRE(merged.cluster_count() == 15000);
+
+    BENCHMARK_ADVANCED("merge 10k + 10k, WORD in 80% of clusters")(Catch::Benchmark::Chronometer meter) {
+        std::vector<Logmine> models(meter.runs(), left);
+        meter.measure([&](int i) { models[i].merge(right); });
+    };
+
+    const auto big_left = synthetic_model(0, 20000, true);
+    const auto big_right = synthetic_model(10000, 30000, true);
+
+    BENCHMARK_ADVANCED("merge 20k + 20k, WORD in 80% of clusters")(Catch::Benchmark::Chronometer meter) {
+        std::vector<Logmine> models(meter.runs(), big_left);
+        meter.measure([&](int i) { models[i].merge(big_right); });
+    };
+}
+
+TEST_CASE( "two phase clustering against full clustering", "[sample]" ) {
+    auto zookeeper = zookeeper_logs();
+
+    std::vector<std::string> lines;
+    for (auto i = 0; i < 10; ++i) {
+        lines.insert(lines.end(), zookeeper.begin(), zookeeper.end());
+    }
+
+    // Returns the cluster of every line in input order
+    auto two_phase = [&](Logmine& model) {
+        SampleAssign sampler{model};
+        auto picked = reservoir_sample(lines.size(), 1000);
+
+        std::vector<std::string> sample;
+        std::vector<std::string> rest;
+        std::vector<bool> in_sample(lines.size());
+        for (std::size_t i = 0, p = 0; i < lines.size(); ++i) {
+            if (p < picked.size() && picked[p] == i) {
+                sample.push_back(lines[i]);
+                in_sample[i] = true;
+                ++p;
+            } else {
+                rest.push_back(lines[i]);
+            }
+        }
+
+        auto sampled = sampler.fit(sample);
+        auto assigned = sampler.assign(rest);
+
+        std::vector<std::size_t> labels(lines.size());
+        for (std::size_t i = 0, s = 0, r = 0; i < lines.size(); ++i) {
+            labels[i] = in_sample[i] ? sampled[s++] : assigned[r++];
+        }
+        return labels;
+    };
+
+    Logmine full;
+    std::vector<std::size_t> full_labels;
+    for (const auto& log : lines) {
+        full_labels.push_back(full.add(log));
+    }
+    Logmine approx;
+    auto labels = two_phase(approx);
+
+    auto divergence = compare(labels, full_labels);
+    std::cout << lines.size() << " lines, clusters: " << divergence.clusters << ", full: " << divergence.full_clusters
+              << ", agreement: " << divergence.agreement << ", adjusted rand: " << divergence.adjusted_rand << std::endl;
+    REQUIRE(divergence.lines == lines.size());
+
+    BENCHMARK("full clustering, 20k lines") {
+        Logmine model;
+        for (const auto& log : lines) {
+            model.add(log);
+        }
+        return model.cluster_count();
+    };
+
+    BENCHMARK("two phase, 1k reservoir sample, 20k lines") {
+        Logmine model;
+        return two_phase(model).size();
+    };
+}
@@ -3,9 +3,11 @@
 
 #include "logmine.h"
 #include "sajson.h"
+#include "logs.h"
 
 #include <unordered_map>
 #include <algorithm>
+#include <sstream>
 
 auto success(const sajson::document& doc) -> bool {
     if (!doc.is_valid()) {
@@ -15,26 +17,6 @@ auto success(const sajson::document& doc) -> bool {
     return true;
 }
 
-// trim from start (in place)
-static inline void ltrim(std::string &s) {
-    s.erase(s.begin(), std::find_if(s.begin(), s.end(), [](unsigned char ch) {
-        return !std::isspace(ch);
-    }));
-}
-
-// trim from end (in place)
-static inline void rtrim(std::string &s) {
-    s.erase(std::find_if(s.rbegin(), s.rend(), [](unsigned char ch) {
-        return !std::isspace(ch);
-    }).base(), s.end());
-}
-
-// trim from both ends (in place)
-static inline void trim(std::string &s) {
-    ltrim(s);
-    rtrim(s);
-}
-
 TEST_CASE( "should test string alignment", "[align2]" ) {
 
     auto t1 = tokenize("2020-09-06T16:00:00 Disconnected from broker broker1");
@@ -106,19 +88,11 @@ TEST_CASE( "test merge", "[merge]" ) {
 }
 
 TEST_CASE( "test zookeeper logs", "[zookeeper]") {
-    std::ifstream logs{"../logs/Zookeeper/Zookeeper_2k.log"};
-
-    REQUIRE( logs.is_open() );
-
     Logmine model;
 
-
-    std::string line;
-    while (std::getline(logs, line)) {
-        trim(line);
+    for (const auto& line : zookeeper_logs()) {
         model.add(line);
     }
-    logs.close();
 
     std::vector<Cluster> clusters = model.get_clusters();
 
@@ -134,6 +108,212 @@ TEST_CASE( "test zookeeper logs", "[zookeeper]") {
     }
 }
 
+TEST_CASE( "snapshot reports only the clusters touched in the interval", "[snapshot]" ) {
+    Logmine model;
+
+    auto broker = model.add("2020-09-06T16:00:00 Disconnected from broker broker1");
+    auto user = model.add("2020-09-06T16:00:00 Connected as user: cching, database: users1");
+
+    auto first = model.snapshot();
+    REQUIRE(first.size() == 2);
+    REQUIRE(first[0].is_new);
+    REQUIRE(first[1].is_new);
+
+    REQUIRE(model.snapshot().empty());
+
+    REQUIRE(model.add("2020-09-06T16:00:00 Disconnected from broker broker2") == broker);
+    REQUIRE(model.add("2020-09-06T16:00:00 Disconnected from broker broker2") == broker);
+
+    auto second = model.snapshot();
+    REQUIRE(second.size() == 1);
+    REQUIRE(second[0].index == broker);
+    REQUIRE(second[0].hits == 2);
+    REQUIRE(second[0].size == 3);
+    REQUIRE_FALSE(second[0].is_new);
+    REQUIRE(second[0].rep_changed);
+    REQUIRE(second[0].id == "DateTime Disconnected from broker WORD");
+
+    REQUIRE(model.add("2020-09-06T16:00:00 Connected as user: cching, database: users1") == user);
+
+    auto third = model.snapshot();
+    REQUIRE(third.size() == 1);
+    REQUIRE(third[0].hits == 1);
+    REQUIRE_FALSE(third[0].rep_changed);
+}
+
+TEST_CASE( "clusters track their rates from the parsed timestamps", "[rates]" ) {
+    Logmine model;
+
+    auto broker = model.add("2020-09-06T16:00:00 Disconnected from broker broker1");
+    model.add("2020-09-06T16:00:01 Disconnected from broker broker2");
+    model.add("2020-09-06T16:01:30 Disconnected from broker broker3");
+    auto user = model.add("2020-09-06T16:01:30 Connected as user: cching, database: users1");
+
+    const std::int64_t now = 1599408090;
+    REQUIRE(model.latest() == now);
+
+    const auto& rates = model.rates(broker);
+    REQUIRE(rates.seconds().count(now) == 1);
+    REQUIRE(rates.minutes().count(now) == 1);
+    REQUIRE(rates.minutes().count(now, 1) == 2);
+    REQUIRE(rates.hours().count(now) == 3);
+
+    REQUIRE(model.rates(user).is_new(now));
+    REQUIRE(model.rates(user).first_seen() == now);
+}
+
+TEST_CASE( "clusters fall back to the wall clock", "[rates]" ) {
+    Logmine model{TimeSource::WallClock};
+
+    auto before = Logmine::wall_clock();
+    auto index = model.add("2020-09-06T16:00:00 Disconnected from broker broker1");
+    auto after = Logmine::wall_clock();
+
+    REQUIRE(model.rates(index).last_seen() >= before);
+    REQUIRE(model.rates(index).last_seen() <= after);
+}
+
+TEST_CASE( "logs without a timestamp take the latest parsed one", "[rates]" ) {
+    Logmine model;
+
+    auto broker = model.add("2020-09-06T16:00:00 Disconnected from broker broker1");
+    model.add("2020-09-06T16:00:30 Disconnected from broker broker2");
+    auto trace = model.add("    at org.apache.zookeeper.server.NIOServerCnxn.doIO");
+    model.add("2020-09-06T16:00:10 Disconnected from broker broker3");
+
+    const std::int64_t now = 1599408030;
+    REQUIRE(model.latest() == now);
+    REQUIRE(model.rates(trace).last_seen() == now);
+    REQUIRE_FALSE(model.rates(broker).has_vanished(model.latest()));
+    REQUIRE(model.rates(broker).seconds().sum(now) == 3);
+    REQUIRE(model.rates(broker).hours().count(now) == 3);
+
+    // Starting mid trace, the wall clock stands in only for the first line
+    Logmine replay;
+    auto first = replay.add("    at org.apache.zookeeper.server.NIOServerCnxn.doIO");
+    replay.add("2015-07-29 19:04:12,394 - INFO  [main:QuorumPeer@913] - tickTime set to 2000");
+    REQUIRE(replay.add("    at org.apache.zookeeper.server.NIOServerCnxn.doIO") == first);
+
+    const std::int64_t then = 1438196652;
+    REQUIRE(replay.latest() == then);
+    REQUIRE(replay.rates(first).last_seen() > then);
+    REQUIRE(replay.rates(first).hours().count(then) == 1);
+}
+
+auto build_model(const std::vector<std::string>& logs) -> Logmine {
+    Logmine model;
+    for (const auto& log : logs) {
+        model.add(log);
+    }
+    return model;
+}
+
+auto cluster_sizes(Logmine& model) -> std::unordered_map<std::string, std::int64_t> {
+    std::unordered_map<std::string, std::int64_t> sizes;
+    for (auto& cluster : model.get_clusters()) {
+        sizes[cluster.id()] += cluster.size();
+    }
+    return sizes;
+}
+
+const std::vector<std::string> brokers{
+    "2020-09-06T16:00:00 Disconnected from broker broker1",
+    "2020-09-06T16:00:01 Disconnected from broker broker2",
+};
+
+const std::vector<std::string> users{
+    "2020-09-06T16:00:00 Connected as user: cching, database: users1",
+    "2020-09-06T16:00:02 Connected as user: blah, database: users1",
+    "2020-09-06T16:00:02 Disconnected from broker broker3",
+};
+
+const std::vector<std::string> queues{
+    "2020-09-06T16:01:00 Queue orders is full, dropping message 12",
+    "2020-09-06T16:01:00 Queue orders is full, dropping message 13",
+    "2020-09-06T16:01:00 Connected as user: root, database: users1",
+};
+
+TEST_CASE( "models survive a save and load round trip", "[save]" ) {
+    auto model = build_model(users);
+
+    std::stringstream saved;
+    model.save(saved);
+    auto loaded = Logmine::load(saved);
+
+    REQUIRE(cluster_sizes(loaded) == cluster_sizes(model));
+    REQUIRE(loaded.latest() == model.latest());
+    REQUIRE(loaded.rates(0).seconds().sum(loaded.latest()) == model.rates(0).seconds().sum(model.latest()));
+    REQUIRE(loaded.rates(0).first_seen() == model.rates(0).first_seen());
+    REQUIRE(loaded.snapshot().empty());
+
+    std::stringstream garbage{"not a model"};
+    REQUIRE_THROWS_AS(Logmine::load(garbage), std::runtime_error);
+}
+
+TEST_CASE( "cluster sizes don't overflow 32 bits", "[save]" ) {
+    std::stringstream saved{"logmine 1 1\n4294967296 2 Text:Disconnected Text:broker 0 0 0 0 0\n"};
+    auto model = Logmine::load(saved);
+
+    auto cluster = model.add("Disconnected broker");
+    REQUIRE(model.get_cluster(cluster).size() == 4294967297);
+    REQUIRE(model.snapshot()[0].size == 4294967297);
+
+    std::stringstream resaved;
+    model.save(resaved);
+    REQUIRE(Logmine::load(resaved).get_cluster(0).size() == 4294967297);
+}
+
+TEST_CASE( "merging models sums the sizes of matching clusters", "[merge]" ) {
+    auto model = build_model(brokers);
+    model.merge(build_model(users));
+
+    auto sizes = cluster_sizes(model);
+    REQUIRE(sizes.size() == 2);
+    REQUIRE(sizes["DateTime Disconnected from broker WORD"] == 3);
+    REQUIRE(sizes["DateTime Connected as user: WORD database: users1"] == 2);
+
+    const auto& rates = model.rates(0);
+    REQUIRE(rates.seconds().sum(model.latest()) == 3);
+    REQUIRE(rates.last_seen() == 1599408002);
+}
+
+TEST_CASE( "merging models is associative", "[merge]" ) {
+    auto left = build_model(brokers);
+    left.merge(build_model(users));
+    left.merge(build_model(queues));
+
+    auto right_tail = build_model(users);
+    right_tail.merge(build_model(queues));
+    auto right = build_model(brokers);
+    right.merge(right_tail);
+
+    auto sizes = cluster_sizes(left);
+    REQUIRE(sizes == cluster_sizes(right));
+    REQUIRE(sizes.size() == 3);
+    REQUIRE(sizes["DateTime Connected as user: WORD database: users1"] == 3);
+}
+
+TEST_CASE( "the cluster index finds every cluster within the distance", "[index]" ) {
+    auto lines = zookeeper_logs();
+    auto model = build_model(lines);
+    auto clusters = model.get_clusters();
+
+    ClusterIndex index;
+    for (std::size_t i = 0; i < clusters.size(); ++i) {
+        index.update(i, clusters[i].representative());
+    }
+
+    for (const auto& log : lines) {
+        auto tokens = tokenize(log);
+        auto candidates = index.candidates(tokens, 0.5);
+        for (std::size_t i = 0; i < clusters.size(); ++i) {
+            if (clusters[i].cluster_distance(tokens) < 0.5) {
+                REQUIRE(std::find(candidates.begin(), candidates.end(), i) != candidates.end());
+            }
+        }
+    }
+}
+
 TEST_CASE( "testing distance", "[distance]") {
     // 2015-07-29 19:04:12,394 - INFO  [/10.10.34.11:3888:QuorumCnxManager$Listener@493] - Received connection request /10.10.34.11:45307
     // 2015-07-29 19:21:42,709 - INFO  [/10.10.34.13:3888:QuorumCnxManager$Listener@493] - Received connection request /10.10.34.13:44219
@@ -0,0 +1,51 @@
+#ifndef TESTS_LOGS_H
+#define TESTS_LOGS_H
+
+#include "catch2/catch.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// trim from start (in place)
+static inline void ltrim(std::string &s) {
+    s.erase(s.begin(), std::find_if(s.begin(), s.end(), [](unsigned char ch) {
+        return !std::isspace(ch);
+    }));
+}
+
+// trim from end (in place)
+static inline void rtrim(std::string &s) {
+    s.erase(std::find_if(s.rbegin(), s.rend(), [](unsigned char ch) {
+        return !std::isspace(ch);
+    }).base(), s.end());
+}
+
+// trim from both ends (in place)
+static inline void trim(std::string &s) {
+    ltrim(s);
+    rtrim(s);
+}
+
+// Trimmed lines of one of the sample logs, paths are relative to the build
+// directory the tests run from
+inline auto read_logs(const std::string& path) -> std::vector<std::string> {
+    std::ifstream logs{path};
+    REQUIRE( logs.is_open() );
+
+    std::vector<std::string> lines;
+    std::string line;
+    while (std::getline(logs, line)) {
+        trim(line);
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+inline auto zookeeper_logs() -> std::vector<std::string> {
+    return read_logs("../logs/Zookeeper/Zookeeper_2k.log");
+}
+
+#endif // TESTS_LOGS_H
@@ -0,0 +1,56 @@
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include "protocol.h"
+
+TEST_CASE( "should round trip a batch of lines", "[protocol]" ) {
+    std::vector<std::string> lines{"first line", "", "third line"};
+    auto encoded = encode_lines(lines);
+
+    Frame frame{};
+    REQUIRE(decode_frame(encoded, frame) == encoded.size());
+    REQUIRE(frame.type == MessageType::Lines);
+    REQUIRE(decode_lines(frame.body) == lines);
+}
+
+TEST_CASE( "should round trip cluster ids", "[protocol]" ) {
+    std::vector<std::uint32_t> ids{0, 7, 3};
+    auto encoded = encode_ids(ids);
+
+    Frame frame{};
+    REQUIRE(decode_frame(encoded, frame) == encoded.size());
+    REQUIRE(frame.type == MessageType::Ids);
+    REQUIRE(decode_ids(frame.body) == ids);
+}
+
+TEST_CASE( "should wait for the whole frame", "[protocol]" ) {
+    auto encoded = encode_lines(std::vector<std::string>{"a line"}) + encode_stats();
+
+    Frame frame{};
+    REQUIRE(decode_frame(std::string_view{encoded}.substr(0, 3), frame) == 0);
+    REQUIRE(decode_frame(std::string_view{encoded}.substr(0, 10), frame) == 0);
+
+    auto used = decode_frame(encoded, frame);
+    REQUIRE(frame.type == MessageType::Lines);
+    REQUIRE(decode_frame(std::string_view{encoded}.substr(used), frame) == encoded.size() - used);
+    REQUIRE(frame.type == MessageType::Stats);
+    REQUIRE(frame.body.empty());
+}
+
+TEST_CASE( "should refuse malformed frames", "[protocol]" ) {
+    Frame frame{};
+
+    std::string huge;
+    put_u32(huge, max_frame_size + 1);
+    REQUIRE_THROWS(decode_frame(huge, frame));
+
+    std::string unknown;
+    put_u32(unknown, 4);
+    put_u32(unknown, 99);
+    REQUIRE_THROWS(decode_frame(unknown, frame));
+
+    std::string truncated;
+    put_u32(truncated, 2);
+    put_u32(truncated, 100);
+    REQUIRE_THROWS(decode_lines(truncated));
+}
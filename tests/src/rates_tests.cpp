@@ -0,0 +1,88 @@
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include "rates.h"
+
+#include <sstream>
+
+TEST_CASE( "should count per bucket and recycle stale buckets", "[rates]" ) {
+    RateWindow<60, 1> window;
+
+    window.add(1000);
+    window.add(1000);
+    window.add(1001);
+
+    REQUIRE(window.count(1000) == 2);
+    REQUIRE(window.count(1001) == 1);
+    REQUIRE(window.count(1001, 1) == 2);
+    REQUIRE(window.sum(1001) == 3);
+
+    // 1060 lands in the same slot as 1000 and replaces it
+    window.add(1060);
+    REQUIRE(window.count(1060) == 1);
+    REQUIRE(window.count(1000) == 0);
+    REQUIRE(window.sum(1060) == 2);
+    REQUIRE(window.sum(1061) == 1);
+
+    // Too old for the window
+    window.add(1000);
+    REQUIRE(window.count(1060) == 1);
+}
+
+TEST_CASE( "should roll counts up into minutes and hours", "[rates]" ) {
+    ClusterRates rates;
+
+    for (auto t = 7200; t < 7200 + 120; ++t) {
+        rates.add(t);
+    }
+
+    REQUIRE(rates.seconds().count(7319) == 1);
+    REQUIRE(rates.seconds().sum(7319) == 60);
+    REQUIRE(rates.minutes().count(7319) == 60);
+    REQUIRE(rates.minutes().sum(7319) == 120);
+    REQUIRE(rates.hours().count(7319) == 120);
+    REQUIRE(rates.first_seen() == 7200);
+    REQUIRE(rates.last_seen() == 7319);
+}
+
+TEST_CASE( "should detect spikes, new and vanished patterns", "[rates]" ) {
+    ClusterRates rates;
+
+    const std::int64_t hour = 3600 * 100;
+    for (auto minute = 0; minute < 59; ++minute) {
+        rates.add(hour + minute * 60, 5);
+    }
+    REQUIRE_FALSE(rates.is_spike(hour + 58 * 60));
+
+    rates.add(hour + 59 * 60, 50);
+    REQUIRE(rates.is_spike(hour + 59 * 60));
+    REQUIRE_FALSE(rates.is_spike(hour + 59 * 60, 20.0));
+
+    REQUIRE(rates.is_new(hour + 30));
+    REQUIRE_FALSE(rates.is_new(hour + 59 * 60));
+
+    REQUIRE_FALSE(rates.has_vanished(hour + 60 * 60));
+    REQUIRE(rates.has_vanished(hour + 59 * 60 + 3600));
+
+    REQUIRE(ClusterRates{}.has_vanished(hour));
+    REQUIRE_FALSE(ClusterRates{}.is_new(hour));
+}
+
+TEST_CASE( "should merge counts past 32 bits", "[rates]" ) {
+    // An hour of a hot cluster on 10 hosts at 200k lines/s each
+    const std::uint64_t per_host = 720000000;
+    ClusterRates fleet;
+    for (auto host = 0; host < 10; ++host) {
+        ClusterRates rates;
+        rates.add(7200, per_host);
+        fleet.merge(rates);
+    }
+    REQUIRE(fleet.hours().count(7200) == 10 * per_host);
+    REQUIRE(fleet.seconds().count(7200) == 10 * per_host);
+
+    std::stringstream saved;
+    fleet.save(saved);
+    ClusterRates loaded;
+    loaded.load(saved);
+    REQUIRE(loaded.hours().count(7200) == 10 * per_host);
+}
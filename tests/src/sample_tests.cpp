@@ -0,0 +1,97 @@
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include "sample.h"
+#include "logs.h"
+
+TEST_CASE( "should assign lines to the frozen clusters", "[sample]" ) {
+    Logmine model;
+    SampleAssign two_phase{model, 2};
+
+    two_phase.fit({
+        "2020-09-06T16:00:00 Disconnected from broker broker1",
+        "2020-09-06T16:00:00 Disconnected from broker broker2",
+    });
+    two_phase.freeze();
+    REQUIRE(model.cluster_count() == 1);
+
+    two_phase.assign({
+        "2020-09-06T16:00:01 Disconnected from broker broker3",
+        "2020-09-06T16:00:02 Connected as user: cching, database: users1",
+        "2020-09-06T16:00:03 Disconnected from broker broker4",
+        "2020-09-06T16:00:04 Connected as user: blah, database: users1",
+    });
+
+    REQUIRE(two_phase.sampled() == 2);
+    REQUIRE(two_phase.assigned() == 2);
+    REQUIRE(two_phase.unmatched() == 2);
+
+    REQUIRE(model.cluster_count() == 2);
+    REQUIRE(model.get_cluster(0).size() == 4);
+    REQUIRE(model.get_cluster(0).id() == "DateTime Disconnected from broker WORD");
+    REQUIRE(model.get_cluster(1).size() == 2);
+    REQUIRE(model.rates(0).last_seen() == 1599408003);
+
+    // Clusters created on the slow path are frozen for the next batch
+    two_phase.assign({"2020-09-06T16:00:05 Connected as user: root, database: users1"});
+    REQUIRE(two_phase.assigned() == 3);
+    REQUIRE(model.get_cluster(1).size() == 3);
+}
+
+TEST_CASE( "should pick a uniform sample in input order", "[sample]" ) {
+    auto sample = reservoir_sample(1000, 10, 42);
+    REQUIRE(sample.size() == 10);
+    REQUIRE(std::is_sorted(sample.begin(), sample.end()));
+    REQUIRE(std::adjacent_find(sample.begin(), sample.end()) == sample.end());
+    REQUIRE(sample.back() < 1000);
+
+    REQUIRE(reservoir_sample(5, 10) == std::vector<std::size_t>{0, 1, 2, 3, 4});
+}
+
+TEST_CASE( "should compare clusterings line by line", "[sample]" ) {
+    auto same = compare({0, 0, 1, 1, 2}, {5, 5, 3, 3, 4});
+    REQUIRE(same.clusters == 3);
+    REQUIRE(same.full_clusters == 3);
+    REQUIRE(same.agreement == 1.0);
+    REQUIRE(same.adjusted_rand == Approx(1.0));
+
+    // Cluster sizes match, the lines in them don't
+    auto shuffled = compare({0, 0, 0, 1, 1, 1}, {0, 1, 1, 0, 0, 1});
+    REQUIRE(shuffled.agreement == Approx(4.0 / 6));
+    REQUIRE(shuffled.adjusted_rand < 0.1);
+
+    // Splitting a cluster keeps every line with its majority but still counts
+    auto split = compare({0, 0, 1, 1, 2, 2}, {0, 0, 0, 0, 1, 1});
+    REQUIRE(split.agreement == 1.0);
+    REQUIRE(split.adjusted_rand < 1.0);
+
+    REQUIRE_THROWS(compare({0, 1}, {0}));
+}
+
+TEST_CASE( "should stay close to full clustering on zookeeper logs", "[sample]" ) {
+    auto lines = zookeeper_logs();
+
+    Logmine full;
+    std::vector<std::size_t> full_labels;
+    for (const auto& line : lines) {
+        full_labels.push_back(full.add(line));
+    }
+
+    Logmine model;
+    SampleAssign two_phase{model, 4};
+    auto labels = two_phase.fit({lines.begin(), lines.begin() + 500});
+    auto assigned = two_phase.assign({lines.begin() + 500, lines.end()});
+    labels.insert(labels.end(), assigned.begin(), assigned.end());
+
+    REQUIRE(two_phase.sampled() + two_phase.assigned() + two_phase.unmatched() == lines.size());
+
+    auto divergence = compare(labels, full_labels);
+    std::cout << "clusters: " << divergence.clusters << ", full: " << divergence.full_clusters
+              << ", agreement: " << divergence.agreement << ", adjusted rand: " << divergence.adjusted_rand << std::endl;
+
+    REQUIRE(divergence.lines == lines.size());
+    REQUIRE(divergence.clusters == model.cluster_count());
+    REQUIRE(divergence.agreement > 0.9);
+    REQUIRE(divergence.adjusted_rand > 0.9);
+    REQUIRE(compare(full_labels, full_labels).adjusted_rand == Approx(1.0));
+}
@@ -0,0 +1,209 @@
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include "server.h"
+#include "client.h"
+
+#include <atomic>
+#include <fcntl.h>
+#include <fstream>
+#include <stdlib.h>
+
+// Runs a server on a temporary socket for the duration of a test
+struct TestServer {
+    Logmine model;
+    std::string path;
+    std::atomic<bool> stop{false};
+    std::unique_ptr<Server> server;
+    std::thread loop;
+
+    TestServer() {
+        char dir[] = "/tmp/server_testsXXXXXX";
+        REQUIRE(mkdtemp(dir) != nullptr);
+        path = std::string{dir} + "/logmine.sock";
+        server = std::make_unique<Server>(model, path, 2);
+        loop = std::thread{[this] { server->run([this] { return stop.load(); }); }};
+    }
+
+    ~TestServer() {
+        stop = true;
+        loop.join();
+    }
+};
+
+TEST_CASE( "should label batches of lines with cluster ids", "[server]" ) {
+    TestServer test;
+    int fd = connect_to(test.path);
+    std::string buffer;
+
+    // Two batches pipelined on one connection come back in order
+    write_all(fd, encode_lines(std::vector<std::string>{
+        "2020-09-06T16:00:00 Disconnected from broker broker1",
+        "2020-09-06T16:00:00 Connected as user: cching, database: users1",
+    }) + encode_lines(std::vector<std::string>{
+        "2020-09-06T16:00:01 Connected as user: blah, database: users1",
+        "2020-09-06T16:00:01 Disconnected from broker broker2",
+        "2020-09-06T16:00:01 Disconnected from broker broker3",
+    }));
+
+    auto first = read_frame(fd, buffer);
+    REQUIRE(first);
+    REQUIRE(first->first == MessageType::Ids);
+    REQUIRE(decode_ids(first->second) == std::vector<std::uint32_t>{0, 1});
+
+    auto second = read_frame(fd, buffer);
+    REQUIRE(second);
+    REQUIRE(decode_ids(second->second) == std::vector<std::uint32_t>{1, 0, 0});
+
+    write_all(fd, encode_stats());
+    auto stats = read_frame(fd, buffer);
+    REQUIRE(stats);
+    REQUIRE(stats->first == MessageType::Stats);
+    REQUIRE(stats->second.find("clusters 2\n") != std::string::npos);
+    REQUIRE(stats->second.find("lines 5\n") != std::string::npos);
+    REQUIRE(stats->second.find("batches 2\n") != std::string::npos);
+
+    ::close(fd);
+}
+
+TEST_CASE( "should share the model between connections", "[server]" ) {
+    TestServer test;
+    int fd1 = connect_to(test.path);
+    int fd2 = connect_to(test.path);
+    std::string buffer1;
+    std::string buffer2;
+
+    write_all(fd1, encode_lines(std::vector<std::string>{"2020-09-06T16:00:00 Disconnected from broker broker1"}));
+    REQUIRE(read_frame(fd1, buffer1));
+
+    write_all(fd2, encode_lines(std::vector<std::string>{"2020-09-06T16:00:00 Disconnected from broker broker2"}));
+    auto ids = read_frame(fd2, buffer2);
+    REQUIRE(ids);
+    REQUIRE(decode_ids(ids->second) == std::vector<std::uint32_t>{0});
+
+    ::close(fd1);
+    ::close(fd2);
+}
+
+TEST_CASE( "should close connections sending malformed frames", "[server]" ) {
+    TestServer test;
+    int fd = connect_to(test.path);
+    std::string buffer;
+
+    std::string garbage;
+    put_u32(garbage, 4);
+    put_u32(garbage, 99);
+    write_all(fd, garbage);
+
+    REQUIRE_FALSE(read_frame(fd, buffer));
+    ::close(fd);
+}
+
+TEST_CASE( "should stop reading from clients that don't read responses", "[server]" ) {
+    TestServer test;
+    int fd = connect_to(test.path);
+    ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    std::vector<std::string> lines(100, "2020-09-06T16:00:00 Disconnected from broker broker1");
+    auto batch = encode_lines(lines);
+
+    // Without backpressure the server would take all of it
+    const std::size_t limit = 16 * 1024 * 1024;
+    std::size_t sent = 0;
+    while (sent < limit) {
+        auto n = ::write(fd, batch.data(), batch.size());
+        if (n < 0) {
+            REQUIRE((errno == EAGAIN || errno == EWOULDBLOCK));
+            break;
+        }
+        sent += n;
+        if (static_cast<std::size_t>(n) < batch.size()) {
+            break;
+        }
+    }
+    REQUIRE(sent < limit);
+
+    int stats_fd = connect_to(test.path);
+    std::string buffer;
+    write_all(stats_fd, encode_stats());
+    auto stats = read_frame(stats_fd, buffer);
+    REQUIRE(stats);
+
+    auto at = stats->second.find("buffered_bytes ");
+    REQUIRE(at != std::string::npos);
+    auto buffered = std::stoul(stats->second.substr(at + 15));
+    REQUIRE(buffered < 2 * batch.size() + 65536);
+
+    ::close(stats_fd);
+    ::close(fd);
+}
+
+TEST_CASE( "should answer requests sent before the client shut down writing", "[server]" ) {
+    TestServer test;
+    int fd = connect_to(test.path);
+    std::string buffer;
+
+    write_all(fd, encode_lines(std::vector<std::string>{"2020-09-06T16:00:00 Disconnected from broker broker1"})
+                + encode_lines(std::vector<std::string>{"2020-09-06T16:00:01 Disconnected from broker broker2"}));
+    REQUIRE(::shutdown(fd, SHUT_WR) == 0);
+
+    auto first = read_frame(fd, buffer);
+    REQUIRE(first);
+    REQUIRE(decode_ids(first->second) == std::vector<std::uint32_t>{0});
+    auto second = read_frame(fd, buffer);
+    REQUIRE(second);
+    REQUIRE(decode_ids(second->second) == std::vector<std::uint32_t>{0});
+
+    // Then the server closes its side
+    REQUIRE_FALSE(read_frame(fd, buffer));
+    ::close(fd);
+}
+
+TEST_CASE( "should leave blank lines out of the model", "[server]" ) {
+    TestServer test;
+    int fd = connect_to(test.path);
+    std::string buffer;
+
+    write_all(fd, encode_lines(std::vector<std::string>{"", "   ", "2020-09-06T16:00:00 Disconnected from broker broker1", "\t", ""}));
+    auto ids = read_frame(fd, buffer);
+    REQUIRE(ids);
+    REQUIRE(decode_ids(ids->second) == std::vector<std::uint32_t>{no_cluster, no_cluster, 0, no_cluster, no_cluster});
+
+    write_all(fd, encode_stats());
+    auto stats = read_frame(fd, buffer);
+    REQUIRE(stats);
+    REQUIRE(stats->second.find("clusters 1\n") != std::string::npos);
+
+    ::close(fd);
+}
+
+TEST_CASE( "should only replace stale sockets", "[server]" ) {
+    char dir[] = "/tmp/server_testsXXXXXX";
+    REQUIRE(mkdtemp(dir) != nullptr);
+    Logmine model;
+
+    // A regular file is never removed
+    auto file = std::string{dir} + "/important.log";
+    { std::ofstream{file} << "keep me\n"; }
+    REQUIRE_THROWS_AS(Server(model, file, 1), std::runtime_error);
+    REQUIRE(std::ifstream{file}.is_open());
+
+    // Nor is a live server's socket taken over
+    TestServer live;
+    REQUIRE_THROWS_AS(Server(model, live.path, 1), std::runtime_error);
+    ::close(connect_to(live.path));
+
+    // A socket nobody listens on anymore is replaced
+    auto stale = std::string{dir} + "/stale.sock";
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::strcpy(address.sun_path, stale.c_str());
+    REQUIRE(::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0);
+    ::close(fd);
+    {
+        Server server{model, stale, 1};
+    }
+    struct stat gone{};
+    REQUIRE(::lstat(stale.c_str(), &gone) < 0);
+}
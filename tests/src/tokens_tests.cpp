@@ -16,3 +16,19 @@ TEST_CASE( "should test token merging", "[merge]" ) {
 
     REQUIRE(untokenize(out, " ") == "This is a WORD test");
 }
+
+TEST_CASE( "should extract the timestamp while tokenizing", "[tokenize]" ) {
+
+    std::int64_t timestamp = -1;
+    tokenize("2015-07-29 19:04:12,394 - INFO Received connection request", &timestamp);
+    REQUIRE(timestamp == 1438196652);
+
+    timestamp = -1;
+    tokenize("2020-09-06T16:00:00 Disconnected from broker broker1", &timestamp);
+    REQUIRE(timestamp == 1599408000);
+
+    timestamp = -1;
+    auto tokens = tokenize("Disconnected from broker broker1", &timestamp);
+    REQUIRE(timestamp == -1);
+    REQUIRE(untokenize(tokens, " ") == "Disconnected from broker broker1");
+}